@@ -6,12 +6,22 @@
 #include <thread>
 #include <math.h>
 #include "headers/MLX90640_API.h"
+#include "headers/MLX90640_Analysis.h"
+#include "headers/MLX90640_Palette.h"
 #include "lib/fb.h"
 
 #define MLX_I2C_ADDR 0x33
 
 #define IMAGE_SCALE 5
 
+// Colour range in degrees C
+#define MIN_TEMP 5.0f
+#define MAX_TEMP 50.0f
+
+// Objects this many degrees C above the median of the scene are marked
+#define BLOB_THRESHOLD 5.0f
+#define BLOB_MIN_AREA 2
+
 // Valid frame rates are 1, 2, 4, 8, 16, 32 and 64
 // The i2c baudrate is set to 1mhz to support these
 #define FPS 8
@@ -134,40 +144,26 @@ void put_number(int x, int y, float number) {
     }
 }
 
-void put_pixel_false_colour(int x, int y, double v) {
-    // Heatmap code borrowed from: http://www.andrewnoske.com/wiki/Code_-_heatmaps_and_color_gradients
-    const int NUM_COLORS = 7;
-    static float color[NUM_COLORS][3] = { {0,0,0}, {0,0,1}, {0,1,0}, {1,1,0}, {1,0,0}, {1,0,1}, {1,1,1} };
-    int idx1, idx2;
-    float fractBetween = 0;
-    float vmin = 5.0;
-    float vmax = 50.0;
-    float vrange = vmax-vmin;
-    v -= vmin;
-    v /= vrange;
-    if(v <= 0) {idx1=idx2=0;}
-    else if(v >= 1) {idx1=idx2=NUM_COLORS-1;}
-    else
-    {
-        v *= (NUM_COLORS-1);
-        idx1 = floor(v);
-        idx2 = idx1+1;
-        fractBetween = v - float(idx1);
-    }
-
-    int ir, ig, ib;
+MLX90640_Palette palette;
 
+void put_cross(int x, int y) {
+    if(x - 1 >= 0){
+        put_pixel_scaled(x - 1, y, 255, 255, 255);
+    }
+    if(x + 1 < 24){
+        put_pixel_scaled(x + 1, y, 255, 255, 255);
+    }
+    if(y - 1 >= 0){
+        put_pixel_scaled(x, y - 1, 255, 255, 255);
+    }
+    if(y + 1 < 32){
+        put_pixel_scaled(x, y + 1, 255, 255, 255);
+    }
+}
 
-    ir = (int)((((color[idx2][0] - color[idx1][0]) * fractBetween) + color[idx1][0]) * 255.0);
-    ig = (int)((((color[idx2][1] - color[idx1][1]) * fractBetween) + color[idx1][1]) * 255.0);
-    ib = (int)((((color[idx2][2] - color[idx1][2]) * fractBetween) + color[idx1][2]) * 255.0);
-
-    put_pixel_scaled(x, y, ir, ig, ib);
-    /*for(int px = 0; px < IMAGE_SCALE; px++){
-        for(int py = 0; py < IMAGE_SCALE; py++){
-            fb_put_pixel(x + px, y + py, ir, ig, ib);
-        }
-    }*/
+void put_pixel_false_colour(int x, int y, double v) {
+    const uint8_t *rgb = MLX90640_PaletteColour(&palette, v);
+    put_pixel_scaled(x, y, rgb[0], rgb[1], rgb[2]);
 }
 
 int main(){
@@ -214,46 +210,39 @@ int main(){
     paramsMLX90640 mlx90640;
     MLX90640_DumpEE(MLX_I2C_ADDR, eeMLX90640);
     MLX90640_ExtractParameters(eeMLX90640, &mlx90640);
+    MLX90640_PaletteInit(&palette, MLX90640_PALETTE_HEATMAP, 256, MLX90640_FORMAT_RGBA32, MIN_TEMP, MAX_TEMP);
 
     fb_init();
 
+    MLX90640_FrameSummary summary = {};
+    static MLX90640_BlobList blobs;
+
     while (1){
-        float hotspot = 0;
-        int hotspot_x = 0;
-        int hotspot_y = 0;
         auto start = std::chrono::system_clock::now();
         MLX90640_GetFrameData(MLX_I2C_ADDR, frame);
         // MLX90640_InterpolateOutliers(frame, eeMLX90640);
 
         eTa = MLX90640_GetTa(frame, &mlx90640);
-        MLX90640_CalculateTo(frame, &mlx90640, emissivity, eTa, mlx90640To);
-
-        MLX90640_BadPixelsCorrection((&mlx90640)->brokenPixels, mlx90640To, 1, &mlx90640);
-        MLX90640_BadPixelsCorrection((&mlx90640)->outlierPixels, mlx90640To, 1, &mlx90640);
+        MLX90640_CalculateToCorrectedSummary(frame, &mlx90640, emissivity, eTa, mlx90640To, &summary);
 
         for(int y = 0; y < 24; y++){
             for(int x = 0; x < 32; x++){
                 float val = mlx90640To[32 * (23-y) + x];
-                if (val > hotspot){
-                    hotspot = val;
-                    hotspot_x = y;
-                    hotspot_y = x;
-                }
                 put_pixel_false_colour(y, x, val);
             }
         }
 
-        if(hotspot_x - 1 >= 0){
-            put_pixel_scaled(hotspot_x - 1, hotspot_y, 255, 255, 255);
-        }
-        if(hotspot_x + 1 < 24){
-            put_pixel_scaled(hotspot_x + 1, hotspot_y, 255, 255, 255);
-        }
-        if(hotspot_y - 1 >= 0){
-            put_pixel_scaled(hotspot_x, hotspot_y - 1, 255, 255, 255);
-        }
-        if(hotspot_y + 1 < 32){
-            put_pixel_scaled(hotspot_x, hotspot_y + 1, 255, 255, 255);
+        // The frame is drawn on its side, sensor row r is screen column 23-r
+        float hotspot = summary.max;
+        int hotspot_x = 23 - summary.maxPixel / 32;
+        int hotspot_y = summary.maxPixel % 32;
+
+        put_cross(hotspot_x, hotspot_y);
+
+        // Warm objects get a dot on their centroid
+        MLX90640_FindBlobs(mlx90640To, MLX90640_THRESHOLD_RELATIVE, BLOB_THRESHOLD, BLOB_MIN_AREA, &blobs);
+        for(int i = 0; i < blobs.count; i++){
+            put_pixel_scaled(23 - (int)(blobs.blob[i].y + 0.5f), (int)(blobs.blob[i].x + 0.5f), 255, 255, 255);
         }
 
         put_number(0, 33, hotspot);
@@ -6,15 +6,21 @@
 #include <thread>
 #include <math.h>
 #include "headers/MLX90640_API.h"
+#include "headers/MLX90640_Analysis.h"
+#include "headers/MLX90640_Render.h"
 #include "lib/fb.h"
-#include "lib/interpolate.h"
 
 #define MLX_I2C_ADDR 0x33
 
 #define IMAGE_SCALE 4
 
-#define OUTPUT_W (int)(24*2)
-#define OUTPUT_H (int)(32*2)
+#define OUTPUT_W (int)(24*2*IMAGE_SCALE)
+#define OUTPUT_H (int)(32*2*IMAGE_SCALE)
+
+// Starting colour range in degrees C, it follows the scene from the
+// first frame on
+#define MIN_TEMP 5.0f
+#define MAX_TEMP 50.0f
 
 // Valid frame rates are 1, 2, 4, 8, 16, 32 and 64
 // The i2c baudrate is set to 1mhz to support these
@@ -27,37 +33,11 @@
 // to account for this.
 #define OFFSET_MICROS 850
 
-void put_pixel_false_colour(int x, int y, double v) {
-    // Heatmap code borrowed from: http://www.andrewnoske.com/wiki/Code_-_heatmaps_and_color_gradients
-    const int NUM_COLORS = 7;
-    static float color[NUM_COLORS][3] = { {0,0,0}, {0,0,1}, {0,1,0}, {1,1,0}, {1,0,0}, {1,0,1}, {1,1,1} };
-    int idx1, idx2;
-    float fractBetween = 0;
-    float vmin = 5.0;
-    float vmax = 50.0;
-    float vrange = vmax-vmin;
-    v -= vmin;
-    v /= vrange;
-    if(v <= 0) {idx1=idx2=0;}
-    else if(v >= 1) {idx1=idx2=NUM_COLORS-1;}
-    else
-    {
-        v *= (NUM_COLORS-1);
-        idx1 = floor(v);
-        idx2 = idx1+1;
-        fractBetween = v - float(idx1);
-    }
-
-    int ir, ig, ib;
-
-
-    ir = (int)((((color[idx2][0] - color[idx1][0]) * fractBetween) + color[idx1][0]) * 255.0);
-    ig = (int)((((color[idx2][1] - color[idx1][1]) * fractBetween) + color[idx1][1]) * 255.0);
-    ib = (int)((((color[idx2][2] - color[idx1][2]) * fractBetween) + color[idx1][2]) * 255.0);
-
-    for(int px = 0; px < IMAGE_SCALE; px++){
-        for(int py = 0; py < IMAGE_SCALE; py++){
-            fb_put_pixel(x + px, y + py, ir, ig, ib);
+// The sensor image is turned on its side, 24 pixels across and 32 down
+static void rotate_frame(const float *to, float *rotated) {
+    for(int y = 0; y < 32; y++){
+        for(int x = 0; x < 24; x++){
+            rotated[24 * y + x] = to[32 * (23 - x) + y];
         }
     }
 }
@@ -67,7 +47,10 @@ int main(){
     float emissivity = 1;
     uint16_t frame[834];
     static float image[768];
-    static float resized[OUTPUT_W * OUTPUT_H];
+    static float rotated[768];
+    static MLX90640_Palette palette;
+    static MLX90640_FrameStats stats;
+    MLX90640_AutoRange range;
     static float mlx90640To[768];
     float eTa;
     static uint16_t data[768*sizeof(float)];
@@ -109,29 +92,40 @@ int main(){
     MLX90640_ExtractParameters(eeMLX90640, &mlx90640);
     fb_init();
 
+    int fb_width, fb_height, fb_stride, fb_bpp, format;
+    char *fb = fb_get_buffer(&fb_width, &fb_height, &fb_stride, &fb_bpp);
+    if(fb_width < OUTPUT_W || fb_height < OUTPUT_H){
+        printf("Framebuffer is smaller than %dx%d\n", OUTPUT_W, OUTPUT_H);
+        fb_cleanup();
+        return 1;
+    }
+    format = (fb_bpp == 32) ? MLX90640_FORMAT_XRGB8888 : (fb_bpp == 16) ? MLX90640_FORMAT_RGB565 : MLX90640_FORMAT_RGB24;
+    MLX90640_PaletteInit(&palette, MLX90640_PALETTE_HEATMAP, 256, format, MIN_TEMP, MAX_TEMP);
+    MLX90640_FrameStatsInit(&stats, -40.0f, 300.0f);
+    MLX90640_AutoRangeInit(&range);
+
+    MLX90640_Upscaler upscaler;
+    MLX90640_UpscalerInit(&upscaler, 24, 32, OUTPUT_W, OUTPUT_H);
+
     while (1){
         auto start = std::chrono::system_clock::now();
         MLX90640_GetFrameData(MLX_I2C_ADDR, frame);
         // MLX90640_InterpolateOutliers(frame, eeMLX90640);
         eTa = MLX90640_GetTa(frame, &mlx90640);
-        MLX90640_CalculateTo(frame, &mlx90640, emissivity, eTa, mlx90640To);
+        MLX90640_CalculateToCorrected(frame, &mlx90640, emissivity, eTa, mlx90640To);
 
-        MLX90640_BadPixelsCorrection((&mlx90640)->brokenPixels, mlx90640To, 1, &mlx90640);
-        MLX90640_BadPixelsCorrection((&mlx90640)->outlierPixels, mlx90640To, 1, &mlx90640);
+        MLX90640_GetFrameStats(&stats, mlx90640To, 768);
+        MLX90640_AutoRangeUpdate(&range, &stats);
+        MLX90640_PaletteSetRange(&palette, range.minTemp, range.maxTemp);
 
-        interpolate_image(mlx90640To, 24, 32, resized, OUTPUT_W, OUTPUT_H);
-
-        for(int y = 0; y < OUTPUT_W; y++){
-            for(int x = 0; x < OUTPUT_H; x++){
-                float val = resized[OUTPUT_H * (OUTPUT_W-1-y) + x];
-                put_pixel_false_colour((y*IMAGE_SCALE), (x*IMAGE_SCALE), val);
-            }
-        }
+        rotate_frame(mlx90640To, rotated);
+        MLX90640_UpscaleFalseColour(&upscaler, rotated, &palette, fb, fb_stride);
         auto end = std::chrono::system_clock::now();
         auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
         std::this_thread::sleep_for(std::chrono::microseconds(frame_time - elapsed));
     }
 
+    MLX90640_UpscalerFree(&upscaler);
     fb_cleanup();
     return 0;
 }
@@ -91,6 +91,14 @@ void fb_put_pixel(int x, int y, int r, int g, int b) {
     }
 }
 
+char *fb_get_buffer(int *width, int *height, int *stride, int *bits_per_pixel) {
+    *width = vinfo.xres;
+    *height = vinfo.yres;
+    *stride = finfo.line_length;
+    *bits_per_pixel = vinfo.bits_per_pixel;
+    return fbp;
+}
+
 int fb_init(){
     // Open the file for reading and writing
     fbfd = open("/dev/fb0", O_RDWR);
@@ -4,6 +4,7 @@
 extern "C" {
 #endif
 void fb_put_pixel(int x, int y, int r, int g, int b);
+char *fb_get_buffer(int *width, int *height, int *stride, int *bits_per_pixel);
 int fb_init();
 void fb_cleanup();
 #ifdef __cplusplus
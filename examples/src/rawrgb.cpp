@@ -8,6 +8,7 @@
 #include <stdlib.h>
 #include <errno.h>
 #include "headers/MLX90640_API.h"
+#include "headers/MLX90640_Palette.h"
 
 /*
  * rawrgb
@@ -89,43 +90,9 @@
 #define PIXEL_SIZE_BYTES 3
 #define IMAGE_SIZE 768*PIXEL_SIZE_BYTES
 
-void put_pixel_false_colour(char *image, int x, int y, double v) {
-    // Heatmap code borrowed from: http://www.andrewnoske.com/wiki/Code_-_heatmaps_and_color_gradients
-    const int NUM_COLORS = 7;
-    static float color[NUM_COLORS][3] = { {0,0,0}, {0,0,1}, {0,1,0}, {1,1,0}, {1,0,0}, {1,0,1}, {1,1,1} };
-    int idx1, idx2;
-    float fractBetween = 0;
-    float vmin = 5.0;
-    float vmax = 50.0;
-    float vrange = vmax-vmin;
-    int offset = (y*32+x) * PIXEL_SIZE_BYTES;
-
-    v -= vmin;
-    v /= vrange;
-    if(v <= 0) {idx1=idx2=0;}
-    else if(v >= 1) {idx1=idx2=NUM_COLORS-1;}
-    else
-    {
-        v *= (NUM_COLORS-1);
-        idx1 = floor(v);
-        idx2 = idx1+1;
-        fractBetween = v - float(idx1);
-    }
-
-    int ir, ig, ib;
-
-
-    ir = (int)((((color[idx2][0] - color[idx1][0]) * fractBetween) + color[idx1][0]) * 255.0);
-    ig = (int)((((color[idx2][1] - color[idx1][1]) * fractBetween) + color[idx1][1]) * 255.0);
-    ib = (int)((((color[idx2][2] - color[idx1][2]) * fractBetween) + color[idx1][2]) * 255.0);
-
-    //put calculated RGB values into image map
-    image[offset] = ir;
-    image[offset + 1] = ig;
-    image[offset + 2] = ib;
-
-
-}
+// Colour range in degrees C
+#define MIN_TEMP 5.0f
+#define MAX_TEMP 50.0f
 
 int main(int argc, char *argv[]){
 
@@ -134,6 +101,7 @@ int main(int argc, char *argv[]){
     uint16_t frame[834];
     static char image[IMAGE_SIZE];
     static float mlx90640To[768];
+    static MLX90640_Palette palette;
     float eTa;
     static uint16_t data[768*sizeof(float)];
     static int fps = FPS;
@@ -185,21 +153,19 @@ int main(int argc, char *argv[]){
     MLX90640_DumpEE(MLX_I2C_ADDR, eeMLX90640);
     MLX90640_SetResolution(MLX_I2C_ADDR, 0x03);
     MLX90640_ExtractParameters(eeMLX90640, &mlx90640);
+    // BGR24 is R, G, B in memory, the byte order of format=rgb
+    MLX90640_PaletteInit(&palette, MLX90640_PALETTE_HEATMAP, 256, MLX90640_FORMAT_BGR24, MIN_TEMP, MAX_TEMP);
 
     while (1){
         auto start = std::chrono::system_clock::now();
-        MLX90640_GetFrameData(MLX_I2C_ADDR, frame);
-        MLX90640_InterpolateOutliers(frame, eeMLX90640);
+        MLX90640_GetFrameDataRepaired(MLX_I2C_ADDR, frame, &mlx90640);
 
         eTa = MLX90640_GetTa(frame, &mlx90640); // Sensor ambient temprature
         MLX90640_CalculateTo(frame, &mlx90640, emissivity, eTa, mlx90640To); //calculate temprature of all pixels, base on emissivity of object
 
         //Fill image array with false-colour data (raw RGB image with 24 x 32 x 24bit per pixel)
         for(int y = 0; y < 24; y++){
-            for(int x = 0; x < 32; x++){
-                float val = mlx90640To[32 * (23-y) + x];
-                put_pixel_false_colour(image, x, y, val);
-            }
+            MLX90640_Colourise(&palette, &mlx90640To[32 * (23-y)], &image[32 * PIXEL_SIZE_BYTES * y], 32);
         }
 
         //wite RGB image to stdout
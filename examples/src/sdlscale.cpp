@@ -6,6 +6,7 @@
 #include <thread>
 #include <math.h>
 #include "headers/MLX90640_API.h"
+#include "headers/MLX90640_Palette.h"
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_render.h>
@@ -15,6 +16,10 @@
 #define SENSOR_W 24
 #define SENSOR_H 32
 
+// Colour range in degrees C
+#define MIN_TEMP 5.0f
+#define MAX_TEMP 50.0f
+
 // Valid frame rates are 1, 2, 4, 8, 16, 32 and 64
 // The i2c baudrate is set to 1mhz to support these
 #define FPS 8
@@ -43,36 +48,15 @@ bool preserve_aspect = true;
 int rotation = 0;
 
 
-void put_pixel_false_colour(int x, int y, double v) {
-    // Heatmap code borrowed from: http://www.andrewnoske.com/wiki/Code_-_heatmaps_and_color_gradients
-    const int NUM_COLORS = 7;
-    static float color[NUM_COLORS][3] = { {0,0,0}, {0,0,1}, {0,1,0}, {1,1,0}, {1,0,0}, {1,0,1}, {1,1,1} };
-    int idx1, idx2;
-    float fractBetween = 0;
-    float vmin = 5.0;
-    float vmax = 50.0;
-    float vrange = vmax-vmin;
-    v -= vmin;
-    v /= vrange;
-    if(v <= 0) {idx1=idx2=0;}
-    else if(v >= 1) {idx1=idx2=NUM_COLORS-1;}
-    else
-    {
-        v *= (NUM_COLORS-1);
-        idx1 = floor(v);
-        idx2 = idx1+1;
-        fractBetween = v - float(idx1);
-    }
-
-    int ir, ig, ib;
-
-    ir = (int)((((color[idx2][0] - color[idx1][0]) * fractBetween) + color[idx1][0]) * 255.0);
-    ig = (int)((((color[idx2][1] - color[idx1][1]) * fractBetween) + color[idx1][1]) * 255.0);
-    ib = (int)((((color[idx2][2] - color[idx1][2]) * fractBetween) + color[idx1][2]) * 255.0);
-
-    int offset = (y * SENSOR_W + x);
+MLX90640_Palette palette;
 
-    pixels[offset] = (ib << 16) | (ig << 8) | (ir << 0);
+// The sensor image is turned on its side, SENSOR_W pixels across
+void rotate_frame(const float *to, float *rotated) {
+    for(int y = 0; y < SENSOR_H; y++){
+        for(int x = 0; x < SENSOR_W; x++){
+            rotated[SENSOR_W * y + x] = to[SENSOR_H * (SENSOR_W - 1 - x) + y];
+        }
+    }
 }
 
 int main(void) {
@@ -128,6 +112,7 @@ int main(void) {
     uint16_t frame[834];
     static float image[768];
     static float mlx90640To[768];
+    static float rotated[768];
     float eTa;
     static uint16_t data[768*sizeof(float)];
 
@@ -166,6 +151,7 @@ int main(void) {
     paramsMLX90640 mlx90640;
     MLX90640_DumpEE(MLX_I2C_ADDR, eeMLX90640);
     MLX90640_ExtractParameters(eeMLX90640, &mlx90640);
+    MLX90640_PaletteInit(&palette, MLX90640_PALETTE_HEATMAP, 256, MLX90640_FORMAT_RGBA32, MIN_TEMP, MAX_TEMP);
 
     while(running){
         while(SDL_PollEvent(&event)) {
@@ -195,17 +181,10 @@ int main(void) {
         MLX90640_GetFrameData(MLX_I2C_ADDR, frame);
 
         eTa = MLX90640_GetTa(frame, &mlx90640);
-        MLX90640_CalculateTo(frame, &mlx90640, emissivity, eTa, mlx90640To);
-
-        MLX90640_BadPixelsCorrection((&mlx90640)->brokenPixels, mlx90640To, 1, &mlx90640);
-        MLX90640_BadPixelsCorrection((&mlx90640)->outlierPixels, mlx90640To, 1, &mlx90640);
+        MLX90640_CalculateToCorrected(frame, &mlx90640, emissivity, eTa, mlx90640To);
 
-        for(int y = 0; y < SENSOR_W; y++){
-            for(int x = 0; x < SENSOR_H; x++){
-                float val = mlx90640To[SENSOR_H * (SENSOR_W-1-y) + x];
-                put_pixel_false_colour(y, x, val);
-            }
-        }
+        rotate_frame(mlx90640To, rotated);
+        MLX90640_Colourise(&palette, rotated, pixels, SENSOR_W * SENSOR_H);
 
         SDL_UpdateTexture(texture, NULL, (uint8_t *)pixels, SENSOR_W * sizeof(uint32_t));
 
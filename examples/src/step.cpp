@@ -59,10 +59,7 @@ int main(){
         // Start the next meausrement
         MLX90640_StartMeasurement(MLX_I2C_ADDR, !subpage);
         eTa = MLX90640_GetTa(frame, &mlx90640);
-        MLX90640_CalculateTo(frame, &mlx90640, emissivity, eTa, mlx90640To);
-
-        MLX90640_BadPixelsCorrection((&mlx90640)->brokenPixels, mlx90640To, 1, &mlx90640);
-        MLX90640_BadPixelsCorrection((&mlx90640)->outlierPixels, mlx90640To, 1, &mlx90640);
+        MLX90640_CalculateToCorrected(frame, &mlx90640, emissivity, eTa, mlx90640To);
 
         printf("Subpage: %d\n", subpage);
 
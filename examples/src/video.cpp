@@ -6,6 +6,7 @@
 #include <thread>
 #include <math.h>
 #include "headers/MLX90640_API.h"
+#include "headers/MLX90640_Palette.h"
 #include "lib/fb.h"
 #include <math.h>
 
@@ -32,6 +33,10 @@ extern "C" {
 
 #define DURATION 5
 
+// Colour range in degrees C
+#define MIN_TEMP 5.0f
+#define MAX_TEMP 50.0f
+
 // Despite the framerate being ostensibly FPS hz
 // The frame is often not ready in time
 // This offset is added to the FRAME_TIME_MICROS
@@ -254,41 +259,15 @@ void video_encode_end()
     //return 0;
 }
 
-void put_pixel_false_colour(int x, int y, double v) {
-	// Heatmap code borrowed from: http://www.andrewnoske.com/wiki/Code_-_heatmaps_and_color_gradients
-	const int NUM_COLORS = 7;
-	static float color[NUM_COLORS][3] = { {0,0,0}, {0,0,1}, {0,1,0}, {1,1,0}, {1,0,0}, {1,0,1}, {1,1,1} };
-	int idx1, idx2;
-	float fractBetween = 0;
-	float vmin = 5.0;
-	float vmax = 50.0;
-	float vrange = vmax-vmin;
-	v -= vmin;
-	v /= vrange;
-	if(v <= 0) {idx1=idx2=0;}
-	else if(v >= 1) {idx1=idx2=NUM_COLORS-1;}
-	else
-	{
-		v *= (NUM_COLORS-1);
-		idx1 = floor(v);
-		idx2 = idx1+1;
-		fractBetween = v - float(idx1);
-	}
-
-	int ir, ig, ib;
-
-	ir = (int)((((color[idx2][0] - color[idx1][0]) * fractBetween) + color[idx1][0]) * 255.0);
-	ig = (int)((((color[idx2][1] - color[idx1][1]) * fractBetween) + color[idx1][1]) * 255.0);
-	ib = (int)((((color[idx2][2] - color[idx1][2]) * fractBetween) + color[idx1][2]) * 255.0);
+MLX90640_Palette palette;
 
-	//printf("Putting pixel to frame\n");
+void put_pixel_false_colour(int x, int y, double v) {
+	const uint8_t *rgb = MLX90640_PaletteColour(&palette, v);
 
-	frame->data[0][y * frame->linesize[0] + (x*3) + 0] = ir;
-	frame->data[0][y * frame->linesize[0] + (x*3) + 1] = ig;
-	frame->data[0][y * frame->linesize[0] + (x*3) + 2] = ib;
-	//frame->data[1][y * frame->linesize[1] + x] = ig;
-	//frame->data[2][y * frame->linesize[2] + x] = ib;
-	fb_put_pixel(x, y, ir, ig, ib);
+	frame->data[0][y * frame->linesize[0] + (x*3) + 0] = rgb[0];
+	frame->data[0][y * frame->linesize[0] + (x*3) + 1] = rgb[1];
+	frame->data[0][y * frame->linesize[0] + (x*3) + 2] = rgb[2];
+	fb_put_pixel(x, y, rgb[0], rgb[1], rgb[2]);
 }
 
 void pulse(){
@@ -341,6 +320,7 @@ int main(){
 	paramsMLX90640 mlx90640;
 	MLX90640_DumpEE(MLX_I2C_ADDR, eeMLX90640);
 	MLX90640_ExtractParameters(eeMLX90640, &mlx90640);
+	MLX90640_PaletteInit(&palette, MLX90640_PALETTE_HEATMAP, 256, MLX90640_FORMAT_RGBA32, MIN_TEMP, MAX_TEMP);
 
 
 	video_encode_start("video.apng", FPS, AV_CODEC_ID_APNG);
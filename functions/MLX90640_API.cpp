@@ -16,10 +16,78 @@
  */
 #include <MLX90640_I2C_Driver.h>
 #include <MLX90640_API.h>
+#include <float.h>
 #include <math.h>
+#include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <chrono>
 
+// Bus cost of one GetFrameData() call: a status poll, the status write, the
+// 832 word RAM read and the status/control reads that follow it. Every byte
+// costs 9 clocks (8 data + ack), every transaction a few more for the
+// start/repeated start/stop conditions.
+#define BUS_BITS_RAM_READ ((1 + 2 + 1 + 2 * 832) * 9 + 3)
+#define BUS_BITS_REG_READ ((1 + 2 + 1 + 2) * 9 + 3)
+#define BUS_BITS_REG_WRITE ((1 + 2 + 2) * 9 + 2)
+#define BUS_BITS_SUBPAGE (BUS_BITS_RAM_READ + 3 * BUS_BITS_REG_READ + BUS_BITS_REG_WRITE)
+// All the bus traffic of a subpage, the RAM read and the register accesses
+// around it, has to fit within this fraction of a subpage period
+#define BUS_HEADROOM 0.5f
+#define BUS_MAX_FREQ 1000
+
+#define ALL_ROWS 0xFFFFFF
+
+// Runtime bad pixel detection. Statistics are averaged over roughly 32
+// updates of a pixel, a pixel is promoted after MONITOR_STRIKES suspicious
+// updates that outnumber the good ones.
+#define MONITOR_ALPHA (1.0f/32)
+#define MONITOR_WARMUP 64
+#define MONITOR_STRIKES 64
+#define MONITOR_STUCK_RATIO 0.05f
+#define MONITOR_NOISE_RATIO 25.0f
+
+// Relative change of the gain word that makes an incremental conversion
+// convert the whole subpage
+#define INCREMENTAL_GAIN_TOLERANCE 0.001f
+
+// Per-pixel NUC gains outside this range are taken for noise, the pixel is
+// left uncorrected rather than costing every alpha its precision
+#define NUC_GAIN_MIN 0.5f
+#define NUC_GAIN_MAX 2.0f
+
+// The auxiliary words of a subpage, sign extended. Filled from a single
+// frame or from an accumulated average.
+typedef struct
+    {
+        float ptatArt;
+        float cp[2];
+        float gain;
+        float ptat;
+        float vdd;
+        uint16_t control;
+        uint16_t subPage;
+    } FrameWords;
+
+// Everything CalculateTo derives once per subpage before the pixel loop
+typedef struct
+    {
+        float vdd;
+        float ta;
+        float ta4;
+        float taTr;
+        float gain;
+        float irDataCP[2];
+        float ktaScale;
+        float kvScale;
+        float alphaScale;
+        float alphaCorrR[4];
+        float ctRadiance[4];
+        float emissivity;
+        uint8_t mode;
+        uint16_t subPage;
+    } FrameContext;
+
 void ExtractVDDParameters(uint16_t *eeData, paramsMLX90640 *mlx90640);
 void ExtractPTATParameters(uint16_t *eeData, paramsMLX90640 *mlx90640);
 void ExtractGainParameters(uint16_t *eeData, paramsMLX90640 *mlx90640);
@@ -36,7 +104,33 @@ void ExtractCILCParameters(uint16_t *eeData, paramsMLX90640 *mlx90640);
 int ExtractDeviatingPixels(uint16_t *eeData, paramsMLX90640 *mlx90640);
 int CheckAdjacentPixels(uint16_t pix1, uint16_t pix2);  
 float GetMedian(float *values, int n);
-int IsPixelBad(uint16_t pixel,paramsMLX90640 *params);
+int IsPixelBad(uint16_t pixel,const paramsMLX90640 *params);
+void BuildCorrectionPlan(paramsMLX90640 *mlx90640);
+void BuildRawRepairPlan(paramsMLX90640 *mlx90640);
+static int ReadFrameData(uint8_t slaveAddr, uint16_t *frameData, const paramsMLX90640 *params, uint32_t rowMask);
+static int ReadRows(uint8_t slaveAddr, uint16_t *frameData, uint32_t rowMask);
+static void UnpackRepaired(const uint8_t *buf, uint16_t *frameData, const paramsMLX90640 *params);
+static void PlanPixelCorrection(uint16_t pixel, paramsMLX90640 *params, MLX90640_PixelCorrection *correction);
+static void SetCorrection(MLX90640_PixelCorrection *correction, int mode, uint8_t method, int8_t offset0, int8_t offset1, int8_t offset2, int8_t offset3);
+static int UsesBadNeighbour(const MLX90640_PixelCorrection *correction, int mode, paramsMLX90640 *params);
+static void PlanFallbackCorrection(MLX90640_PixelCorrection *correction, int mode, paramsMLX90640 *params);
+static inline void CorrectPixel(float *to, const MLX90640_PixelCorrection *correction, int mode);
+static void GetFrameWords(uint16_t *frameData, FrameWords *words);
+static float CalculateVdd(const FrameWords *words, const paramsMLX90640 *params);
+static float CalculateTa(const FrameWords *words, const paramsMLX90640 *params);
+static void GetFrameContext(const FrameWords *words, const paramsMLX90640 *params, float emissivity, float tr, FrameContext *ctx);
+static void GetAccumulatedWords(const MLX90640_RawAccumulator *acc, int subPage, FrameWords *words);
+static inline float SignedWord(uint16_t word);
+static inline int GetPixelPattern(int pixelNumber, uint8_t mode);
+static inline float CompensatePixel(float irData, int pixelNumber, const FrameContext *ctx, const paramsMLX90640 *params, float *alphaCompensated);
+static inline float CalculatePixelTo(float irData, int pixelNumber, const FrameContext *ctx, const paramsMLX90640 *params);
+static inline float SolvePixelTo(float irData, float alphaCompensated, float taTr, const FrameContext *ctx, const paramsMLX90640 *params);
+static inline float CalculatePixelRadiance(float irData, int pixelNumber, const FrameContext *ctx, const paramsMLX90640 *params);
+static inline float FastRoot4(float x);
+static void ConvertFrame(uint16_t *frameData, const paramsMLX90640 *params, float emissivity, float tr, float *result, int corrected, MLX90640_FrameSummary *summary);
+static void StartSummary(MLX90640_FrameSummary *summary);
+static inline void AddToSummary(MLX90640_FrameSummary *summary, int pixelNumber, float to);
+static int NeedsFullConversion(const MLX90640_IncrementalState *state, const FrameContext *ctx, const paramsMLX90640 *params, float tr);
 
   
 int MLX90640_DumpEE(uint8_t slaveAddr, uint16_t *eeData)
@@ -73,7 +167,7 @@ int MLX90640_GetData(uint8_t slaveAddr, uint16_t *frameData)
     uint16_t controlRegister1;
 
     // Get page data
-    error = MLX90640_I2CRead(slaveAddr, 0x0400, 832, frameData);
+    error = MLX90640_I2CReadBurst(slaveAddr, 0x0400, 832, frameData);
     
     // Get status reguster
     MLX90640_I2CRead(slaveAddr, 0x8000, 1, &statusRegister);
@@ -118,6 +212,43 @@ int MLX90640_InterpolateOutliers(uint16_t *frameData, uint16_t *eepromData)
 
 int MLX90640_GetFrameData(uint8_t slaveAddr, uint16_t *frameData)
 {
+    return ReadFrameData(slaveAddr, frameData, 0, ALL_ROWS);
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_GetFrameDataRepaired(uint8_t slaveAddr, uint16_t *frameData, const paramsMLX90640 *params)
+{
+    return ReadFrameData(slaveAddr, frameData, params, ALL_ROWS);
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_GetFrameDataPixels(uint8_t slaveAddr, uint16_t *frameData, const uint16_t *pixels, int n)
+{
+    uint32_t rowMask = 0;
+    
+    for(int i = 0; i < n; i++)
+    {
+        if(pixels[i] > 767)
+        {
+            return -1;
+        }
+        rowMask |= 1 << (pixels[i] / 32);
+    }
+    if(rowMask == 0)
+    {
+        return -1;
+    }
+    
+    return ReadFrameData(slaveAddr, frameData, 0, rowMask);
+}
+
+//------------------------------------------------------------------------------
+
+static int ReadFrameData(uint8_t slaveAddr, uint16_t *frameData, const paramsMLX90640 *params, uint32_t rowMask)
+{
+    uint8_t buf[1664];
     uint16_t dataReady = 1;
     uint16_t controlRegister1;
     uint16_t statusRegister;
@@ -151,12 +282,27 @@ int MLX90640_GetFrameData(uint8_t slaveAddr, uint16_t *frameData)
             return error;
         }
 
-        error = MLX90640_I2CRead(slaveAddr, 0x0400, 832, frameData); 
+        if(rowMask != ALL_ROWS)
+        {
+            error = ReadRows(slaveAddr, frameData, rowMask);
+        }
+        else if(params != 0 && params->rawRepairCount > 0)
+        {
+            error = MLX90640_I2CReadBurstBytes(slaveAddr, 0x0400, 832, buf); 
+        }
+        else
+        {
+            error = MLX90640_I2CReadBurst(slaveAddr, 0x0400, 832, frameData); 
+        }
         if(error != 0)
         {
             printf("frameData read error \n");
             return error;
         }
+        if(rowMask == ALL_ROWS && params != 0 && params->rawRepairCount > 0)
+        {
+            UnpackRepaired(buf, frameData, params);
+        }
 
         error = MLX90640_I2CRead(slaveAddr, 0x8000, 1, &statusRegister);
         if(error != 0)
@@ -165,6 +311,10 @@ int MLX90640_GetFrameData(uint8_t slaveAddr, uint16_t *frameData)
         }
         dataReady = statusRegister & 0x0008;
         cnt = cnt + 1;
+        if(dataReady != 0)
+        {
+            MLX90640_I2CProfileRetry(0x0400);
+        }    
     }
 
     if(cnt > 4)
@@ -185,6 +335,69 @@ int MLX90640_GetFrameData(uint8_t slaveAddr, uint16_t *frameData)
     return frameData[833];    
 }
 
+//------------------------------------------------------------------------------
+
+static int ReadRows(uint8_t slaveAddr, uint16_t *frameData, uint32_t rowMask)
+{
+    int error;
+    int first;
+    int last;
+    
+    // One burst per run of wanted rows, then the auxiliary words the
+    // conversion needs
+    first = 0;
+    while(first < 24)
+    {
+        if((rowMask & (1 << first)) == 0)
+        {
+            first = first + 1;
+            continue;
+        }
+        last = first;
+        while(last + 1 < 24 && (rowMask & (1 << (last + 1))) != 0)
+        {
+            last = last + 1;
+        }
+        
+        error = MLX90640_I2CReadBurst(slaveAddr, 0x0400 + 32 * first, 32 * (last - first + 1), &frameData[32 * first]);
+        if(error != 0)
+        {
+            return error;
+        }
+        first = last + 1;
+    }
+    
+    return MLX90640_I2CReadBurst(slaveAddr, 0x0700, 64, &frameData[768]);
+}
+
+//------------------------------------------------------------------------------
+
+static void UnpackRepaired(const uint8_t *buf, uint16_t *frameData, const paramsMLX90640 *params)
+{
+    const MLX90640_RawRepair *repair = params->rawRepair;
+    const MLX90640_RawRepair *end = repair + params->rawRepairCount;
+    float val;
+    
+    for(int count = 0; count < 832; count++)
+    {
+        frameData[count] = ((uint16_t)buf[2*count] << 8) | buf[2*count+1];
+        
+        // The furthest neighbour is 33 words on, so a pixel is repaired once
+        // that has been unpacked. Lower pixels are already repaired by then,
+        // just as in the in-place MLX90640_InterpolateOutliers.
+        while(repair != end && repair->pixel + 33 <= count)
+        {
+            val = 0;
+            for(int i = 0; i < repair->count; i++)
+            {
+                val += frameData[repair->pixel + repair->offset[i]];
+            }
+            frameData[repair->pixel] = (uint16_t)((float)(val / repair->count) * 1.0003);
+            repair = repair + 1;
+        }
+    }
+}
+
 int MLX90640_ExtractParameters(uint16_t *eeData, paramsMLX90640 *mlx90640)
 {
     int error = 0;
@@ -203,6 +416,8 @@ int MLX90640_ExtractParameters(uint16_t *eeData, paramsMLX90640 *mlx90640)
     ExtractKvPixelParameters(eeData, mlx90640);
     ExtractCILCParameters(eeData, mlx90640);
     error = ExtractDeviatingPixels(eeData, mlx90640);  
+    BuildCorrectionPlan(mlx90640);
+    BuildRawRepairPlan(mlx90640);
     
     return error;
 
@@ -287,6 +502,71 @@ int MLX90640_GetRefreshRate(uint8_t slaveAddr)
 
 //------------------------------------------------------------------------------
 
+int MLX90640_GetBusBudget(uint8_t refreshRate, int maxFreq, MLX90640_BusBudget *budget)
+{
+    static const int standardFreq[3] = {100, 400, 1000};
+    int error = -1;
+    
+    if(maxFreq <= 0 || maxFreq > BUS_MAX_FREQ)
+    {
+        maxFreq = BUS_MAX_FREQ;
+    }
+    
+    budget->subPageRate = 0.5f * (1 << (refreshRate & 0x07));
+    budget->bitsPerSubPage = BUS_BITS_SUBPAGE;
+    budget->requiredFreq = (int)ceil(budget->bitsPerSubPage * budget->subPageRate / BUS_HEADROOM / 1000.0f);
+    
+    budget->busFreq = maxFreq;
+    for(int i = 0; i < 3; i++)
+    {
+        if(standardFreq[i] >= budget->requiredFreq && standardFreq[i] <= maxFreq)
+        {
+            budget->busFreq = standardFreq[i];
+            error = 0;
+            break;
+        }
+    }    
+    if(error != 0 && maxFreq >= budget->requiredFreq)
+    {
+        error = 0;
+    }
+    
+    budget->burstFreq = budget->busFreq;
+    budget->readTime = (float)BUS_BITS_RAM_READ / budget->burstFreq;
+    budget->busLoad = budget->bitsPerSubPage * budget->subPageRate / (budget->busFreq * 1000.0f);
+    budget->applied = 0;
+    
+    return error;
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_SetBusClock(uint8_t slaveAddr, uint8_t refreshRate, int maxFreq, MLX90640_BusBudget *budget)
+{
+    int error;
+    
+    error = MLX90640_GetBusBudget(refreshRate, maxFreq, budget);
+    
+    if(MLX90640_I2CSetFreq(slaveAddr, budget->busFreq) == 0)
+    {
+        budget->applied = 1;
+        
+        if(maxFreq > budget->busFreq && MLX90640_I2CSetBurstFreq(slaveAddr, maxFreq) == 0)
+        {
+            budget->burstFreq = maxFreq;
+            budget->readTime = (float)BUS_BITS_RAM_READ / budget->burstFreq;
+        }
+        else
+        {
+            MLX90640_I2CSetBurstFreq(slaveAddr, 0);
+        }    
+    }
+    
+    return error;
+}
+
+//------------------------------------------------------------------------------
+
 int MLX90640_SetInterleavedMode(uint8_t slaveAddr)
 {
     uint16_t controlRegister1;
@@ -405,163 +685,956 @@ int MLX90640_SetSubPage(uint8_t slaveAddr, uint8_t subPage)
 
 void MLX90640_CalculateTo(uint16_t *frameData, const paramsMLX90640 *params, float emissivity, float tr, float *result)
 {
-    float vdd;
-    float ta;
-    float ta4;
-    float tr4;
-    float taTr;
-    float gain;
-    float irDataCP[2];
-    float irData;
-    float alphaCompensated;
-    uint8_t mode;
-    int8_t ilPattern;
-    int8_t chessPattern;
-    int8_t pattern;
-    int8_t conversionPattern;
-    float Sx;
-    float To;
-    float alphaCorrR[4];
-    int8_t range;
-    uint16_t subPage;
-    float ktaScale;
-    float kvScale;
-    float alphaScale;
-    float kta;
-    float kv;
-    
-    subPage = frameData[833];
-    vdd = MLX90640_GetVdd(frameData, params);
-    ta = MLX90640_GetTa(frameData, params);
-    
-    ta4 = (ta + 273.15);
-    ta4 = ta4 * ta4;
-    ta4 = ta4 * ta4;
-    tr4 = (tr + 273.15);
-    tr4 = tr4 * tr4;
-    tr4 = tr4 * tr4;
-    taTr = tr4 - (tr4-ta4)/emissivity;
-    
-    ktaScale = pow(2,(double)params->ktaScale);
-    kvScale = pow(2,(double)params->kvScale);
-    alphaScale = pow(2,(double)params->alphaScale);
-    
-    alphaCorrR[0] = 1 / (1 + params->ksTo[0] * 40);
-    alphaCorrR[1] = 1 ;
-    alphaCorrR[2] = (1 + params->ksTo[1] * params->ct[2]);
-    alphaCorrR[3] = alphaCorrR[2] * (1 + params->ksTo[2] * (params->ct[3] - params->ct[2]));
-    
-//------------------------- Gain calculation -----------------------------------    
-    gain = frameData[778];
-    if(gain > 32767)
-    {
-        gain = gain - 65536;
-    }
+    ConvertFrame(frameData, params, emissivity, tr, result, 0, 0);
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_CalculateToCorrected(uint16_t *frameData, const paramsMLX90640 *params, float emissivity, float tr, float *result)
+{
+    ConvertFrame(frameData, params, emissivity, tr, result, 1, 0);
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_CalculateToSummary(uint16_t *frameData, const paramsMLX90640 *params, float emissivity, float tr, float *result, MLX90640_FrameSummary *summary)
+{
+    ConvertFrame(frameData, params, emissivity, tr, result, 0, summary);
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_CalculateToCorrectedSummary(uint16_t *frameData, const paramsMLX90640 *params, float emissivity, float tr, float *result, MLX90640_FrameSummary *summary)
+{
+    ConvertFrame(frameData, params, emissivity, tr, result, 1, summary);
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_CalculateToPixels(uint16_t *frameData, const paramsMLX90640 *params, float emissivity, float tr, const uint16_t *pixels, int n, float *result)
+{
+    FrameWords words;
+    FrameContext ctx;
+    int converted = 0;
     
-    gain = params->gainEE / gain; 
-  
-//------------------------- To calculation -------------------------------------    
-    mode = (frameData[832] & 0x1000) >> 5;
+    GetFrameWords(frameData, &words);
+    GetFrameContext(&words, params, emissivity, tr, &ctx);
     
-    irDataCP[0] = frameData[776];  
-    irDataCP[1] = frameData[808];
-    for( int i = 0; i < 2; i++)
+    for(int i = 0; i < n; i++)
     {
-        if(irDataCP[i] > 32767)
+        if(pixels[i] < 768 && GetPixelPattern(pixels[i], ctx.mode) == ctx.subPage)
         {
-            irDataCP[i] = irDataCP[i] - 65536;
+            result[pixels[i]] = CalculatePixelTo(SignedWord(frameData[pixels[i]]), pixels[i], &ctx, params);
+            converted = converted + 1;
         }
-        irDataCP[i] = irDataCP[i] * gain;
     }
-    irDataCP[0] = irDataCP[0] - params->cpOffset[0] * (1 + params->cpKta * (ta - 25)) * (1 + params->cpKv * (vdd - 3.3));
-    if( mode ==  params->calibrationModeEE)
+    
+    return converted;
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_EmissivityMapInit(MLX90640_EmissivityMap *map, float emissivity, float tr)
+{
+    for(int i = 0; i < 768; i++)
     {
-        irDataCP[1] = irDataCP[1] - params->cpOffset[1] * (1 + params->cpKta * (ta - 25)) * (1 + params->cpKv * (vdd - 3.3));
+        map->emissivity[i] = emissivity;
+        map->tr[i] = tr;
     }
-    else
+    MLX90640_EmissivityMapUpdate(map);
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_EmissivityMapSetRegion(MLX90640_EmissivityMap *map, int left, int top, int right, int bottom, float emissivity, float tr)
+{
+    if(left < 0 || left > right || right > 31 || top < 0 || top > bottom || bottom > 23 || !(emissivity > 0))
     {
-      irDataCP[1] = irDataCP[1] - (params->cpOffset[1] + params->ilChessC[0]) * (1 + params->cpKta * (ta - 25)) * (1 + params->cpKv * (vdd - 3.3));
+        return -1;
     }
-
-    for( int pixelNumber = 0; pixelNumber < 768; pixelNumber++)
+    
+    for(int y = top; y <= bottom; y++)
     {
-        ilPattern = pixelNumber / 32 - (pixelNumber / 64) * 2; 
-        chessPattern = ilPattern ^ (pixelNumber - (pixelNumber/2)*2); 
-        conversionPattern = ((pixelNumber + 2) / 4 - (pixelNumber + 3) / 4 + (pixelNumber + 1) / 4 - pixelNumber / 4) * (1 - 2 * ilPattern);
-        
-        if(mode == 0)
+        for(int x = left; x <= right; x++)
         {
-          pattern = ilPattern; 
+            map->emissivity[32 * y + x] = emissivity;
+            map->tr[32 * y + x] = tr;
         }
-        else 
-        {
-          pattern = chessPattern; 
-        }               
-        
-        if(pattern == frameData[833])
-        {    
-            irData = frameData[pixelNumber];
-            if(irData > 32767)
-            {
-                irData = irData - 65536;
-            }
-            irData = irData * gain;
-            
-            kta = params->kta[pixelNumber]/ktaScale;
-            kv = params->kv[pixelNumber]/kvScale;
-            irData = irData - params->offset[pixelNumber]*(1 + kta*(ta - 25))*(1 + kv*(vdd - 3.3));
-            
-            if(mode !=  params->calibrationModeEE)
-            {
-              irData = irData + params->ilChessC[2] * (2 * ilPattern - 1) - params->ilChessC[1] * conversionPattern; 
-            }                       
+    }
+    MLX90640_EmissivityMapUpdate(map);
     
-            irData = irData - params->tgc * irDataCP[subPage];
-            irData = irData / emissivity;
-            
-            alphaCompensated = SCALEALPHA*alphaScale/params->alpha[pixelNumber];
-            alphaCompensated = alphaCompensated*(1 + params->KsTa * (ta - 25));
-                        
-            Sx = alphaCompensated * alphaCompensated * alphaCompensated * (irData + alphaCompensated * taTr);
-            Sx = sqrt(sqrt(Sx)) * params->ksTo[1];            
-            
-            To = sqrt(sqrt(irData/(alphaCompensated * (1 - params->ksTo[1] * 273.15) + Sx) + taTr)) - 273.15;                     
-                    
-            if(To < params->ct[1])
-            {
-                range = 0;
-            }
-            else if(To < params->ct[2])   
-            {
-                range = 1;            
-            }   
-            else if(To < params->ct[3])
-            {
-                range = 2;            
-            }
-            else
-            {
-                range = 3;            
-            }      
-            
-            To = sqrt(sqrt(irData / (alphaCompensated * alphaCorrR[range] * (1 + params->ksTo[range] * (To - params->ct[range]))) + taTr)) - 273.15;
-                        
-            result[pixelNumber] = To;
-        }
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_EmissivityMapUpdate(MLX90640_EmissivityMap *map)
+{
+    float tr4;
+    
+    // taTr = tr4 - (tr4 - ta4) / emissivity = taTrOffset + ta4 * invEmissivity
+    for(int i = 0; i < 768; i++)
+    {
+        tr4 = (map->tr[i] + 273.15);
+        tr4 = tr4 * tr4;
+        tr4 = tr4 * tr4;
+        map->invEmissivity[i] = 1 / map->emissivity[i];
+        map->taTrOffset[i] = tr4 * (1 - map->invEmissivity[i]);
     }
 }
 
 //------------------------------------------------------------------------------
 
-void MLX90640_GetImage(uint16_t *frameData, const paramsMLX90640 *params, float *result)
+void MLX90640_CalculateToMap(uint16_t *frameData, const paramsMLX90640 *params, const MLX90640_EmissivityMap *map, float *result)
 {
-    float vdd;
-    float ta;
-    float gain;
-    float irDataCP[2];
-    float irData;
+    FrameWords words;
+    FrameContext ctx;
     float alphaCompensated;
-    uint8_t mode;
+    float irData;
+    float taTr;
+    
+    // Unit emissivity leaves the context free of the scene, the map
+    // supplies it per pixel
+    GetFrameWords(frameData, &words);
+    GetFrameContext(&words, params, 1, 0, &ctx);
+    
+    for(int pixelNumber = 0; pixelNumber < 768; pixelNumber++)
+    {
+        if(GetPixelPattern(pixelNumber, ctx.mode) == ctx.subPage)
+        {
+            irData = CompensatePixel(SignedWord(frameData[pixelNumber]), pixelNumber, &ctx, params, &alphaCompensated);
+            irData = irData * map->invEmissivity[pixelNumber];
+            taTr = map->taTrOffset[pixelNumber] + ctx.ta4 * map->invEmissivity[pixelNumber];
+            result[pixelNumber] = SolvePixelTo(irData, alphaCompensated, taTr, &ctx, params);
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_CalculateRadiance(uint16_t *frameData, const paramsMLX90640 *params, float emissivity, float tr, float *result)
+{
+    FrameWords words;
+    FrameContext ctx;
+    
+    GetFrameWords(frameData, &words);
+    GetFrameContext(&words, params, emissivity, tr, &ctx);
+    
+    for(int pixelNumber = 0; pixelNumber < 768; pixelNumber++)
+    {
+        if(GetPixelPattern(pixelNumber, ctx.mode) == ctx.subPage)
+        {
+            result[pixelNumber] = CalculatePixelRadiance(SignedWord(frameData[pixelNumber]), pixelNumber, &ctx, params);
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+
+float MLX90640_TemperatureToRadiance(float to)
+{
+    float t;
+    
+    t = to + 273.15f;
+    t = t * t;
+    return t * t;
+}
+
+//------------------------------------------------------------------------------
+
+float MLX90640_RadianceToTemperature(float radiance)
+{
+    return sqrtf(sqrtf(radiance)) - 273.15f;
+}
+
+//------------------------------------------------------------------------------
+
+static void ConvertFrame(uint16_t *frameData, const paramsMLX90640 *params, float emissivity, float tr, float *result, int corrected, MLX90640_FrameSummary *summary)
+{
+    FrameWords words;
+    FrameContext ctx;
+    float irData;
+    int mode;
+    int bad;
+    
+    GetFrameWords(frameData, &words);
+    GetFrameContext(&words, params, emissivity, tr, &ctx);
+    if(summary != 0)
+    {
+        StartSummary(summary);
+    }
+
+    for( int pixelNumber = 0; pixelNumber < 768; pixelNumber++)
+    {
+        bad = corrected && (params->badPixelMask[pixelNumber>>3] & (1 << (pixelNumber & 7))) != 0;
+        if(GetPixelPattern(pixelNumber, ctx.mode) == ctx.subPage)
+        {
+            // Bad pixels of this subpage are summarised once corrected
+            if(bad)
+            {
+                continue;
+            }
+            
+            irData = frameData[pixelNumber];
+            if(irData > 32767)
+            {
+                irData = irData - 65536;
+            }
+            
+            result[pixelNumber] = CalculatePixelTo(irData, pixelNumber, &ctx, params);
+        }
+        if(summary != 0)
+        {
+            AddToSummary(summary, pixelNumber, result[pixelNumber]);
+        }
+    }
+    
+    if(corrected == 0)
+    {
+        return;
+    }
+    
+    // The neighbours used for a correction always belong to the same subpage,
+    // so bad pixels of this subpage can be filled in straight away.
+    mode = (ctx.mode != 0);
+    for(int i = 0; i < params->correctionCount; i++)
+    {
+        if(GetPixelPattern(params->correction[i].pixel, ctx.mode) == ctx.subPage)
+        {
+            CorrectPixel(result, &params->correction[i], mode);
+            if(summary != 0)
+            {
+                AddToSummary(summary, params->correction[i].pixel, result[params->correction[i].pixel]);
+            }
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+
+static void StartSummary(MLX90640_FrameSummary *summary)
+{
+    summary->min = FLT_MAX;
+    summary->max = -FLT_MAX;
+    summary->minPixel = 0;
+    summary->maxPixel = 0;
+    summary->count = 0;
+    summary->countBelow = 0;
+    summary->countAbove = 0;
+    summary->sum = 0;
+    summary->sumSquares = 0;
+}
+
+//------------------------------------------------------------------------------
+
+static inline void AddToSummary(MLX90640_FrameSummary *summary, int pixelNumber, float to)
+{
+    if(to != to)
+    {
+        return;
+    }
+    
+    if(to < summary->min)
+    {
+        summary->min = to;
+        summary->minPixel = pixelNumber;
+    }
+    if(to > summary->max)
+    {
+        summary->max = to;
+        summary->maxPixel = pixelNumber;
+    }
+    summary->count++;
+    summary->countBelow += (to < summary->lowThreshold);
+    summary->countAbove += (to > summary->highThreshold);
+    summary->sum += to;
+    summary->sumSquares += (double)to * to;
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_IncrementalInit(MLX90640_IncrementalState *state)
+{
+    memset(state, 0, sizeof(MLX90640_IncrementalState));
+    state->refreshInterval = 16;
+    state->rawThreshold = 1;
+    state->taThreshold = 0.1f;
+    state->vddThreshold = 0.01f;
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_IncrementalReset(MLX90640_IncrementalState *state)
+{
+    // Keeps the thresholds, only forces the next full conversions
+    state->primed[0] = 0;
+    state->primed[1] = 0;
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_CalculateToIncremental(MLX90640_IncrementalState *state, uint16_t *frameData, const paramsMLX90640 *params, float emissivity, float tr, float *result)
+{
+    FrameWords words;
+    FrameContext ctx;
+    int16_t raw;
+    int subPage;
+    int full;
+    
+    GetFrameWords(frameData, &words);
+    GetFrameContext(&words, params, emissivity, tr, &ctx);
+    subPage = ctx.subPage & 1;
+    
+    full = NeedsFullConversion(state, &ctx, params, tr);
+    if(full)
+    {
+        state->ta[subPage] = ctx.ta;
+        state->vdd[subPage] = ctx.vdd;
+        state->gain[subPage] = ctx.gain;
+        state->irDataCP[subPage] = ctx.irDataCP[subPage];
+        state->tr[subPage] = tr;
+        state->emissivity[subPage] = emissivity;
+        state->mode[subPage] = ctx.mode;
+        state->primed[subPage] = 1;
+        state->sinceRefresh[subPage] = 0;
+    }
+    state->sinceRefresh[subPage]++;
+    
+    state->converted = 0;
+    for(int pixelNumber = 0; pixelNumber < 768; pixelNumber++)
+    {
+        if(GetPixelPattern(pixelNumber, ctx.mode) != ctx.subPage || (params->badPixelMask[pixelNumber>>3] & (1 << (pixelNumber & 7))) != 0)
+        {
+            continue;
+        }
+        
+        raw = (int16_t)frameData[pixelNumber];
+        if(full || abs(raw - state->raw[pixelNumber]) > state->rawThreshold)
+        {
+            state->raw[pixelNumber] = raw;
+            state->to[pixelNumber] = CalculatePixelTo(raw, pixelNumber, &ctx, params);
+            state->converted++;
+        }
+        result[pixelNumber] = state->to[pixelNumber];
+    }
+    
+    // Corrections read the neighbours in result, they are cheap enough to
+    // redo every time
+    for(int i = 0; i < params->correctionCount; i++)
+    {
+        if(GetPixelPattern(params->correction[i].pixel, ctx.mode) == ctx.subPage)
+        {
+            CorrectPixel(result, &params->correction[i], ctx.mode != 0);
+        }
+    }
+    
+    return state->converted;
+}
+
+//------------------------------------------------------------------------------
+
+static int NeedsFullConversion(const MLX90640_IncrementalState *state, const FrameContext *ctx, const paramsMLX90640 *params, float tr)
+{
+    int subPage;
+    
+    subPage = ctx->subPage & 1;
+    if(state->primed[subPage] == 0 || state->mode[subPage] != ctx->mode)
+    {
+        return 1;
+    }
+    if(state->refreshInterval > 0 && state->sinceRefresh[subPage] >= state->refreshInterval)
+    {
+        return 1;
+    }
+    if(state->tr[subPage] != tr || state->emissivity[subPage] != ctx->emissivity)
+    {
+        return 1;
+    }
+    if(fabsf(ctx->ta - state->ta[subPage]) > state->taThreshold || fabsf(ctx->vdd - state->vdd[subPage]) > state->vddThreshold)
+    {
+        return 1;
+    }
+    // The CP reading comes off every pixel scaled by tgc, a drift worth more
+    // than rawThreshold raw counts moves all of them at once
+    if(fabsf(params->tgc * (ctx->irDataCP[subPage] - state->irDataCP[subPage])) > state->rawThreshold * fabsf(ctx->gain))
+    {
+        return 1;
+    }
+    
+    return fabsf(ctx->gain - state->gain[subPage]) > INCREMENTAL_GAIN_TOLERANCE * fabsf(state->gain[subPage]);
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_AccumulatorReset(MLX90640_RawAccumulator *acc)
+{
+    memset(acc, 0, sizeof(MLX90640_RawAccumulator));
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_AccumulateFrame(MLX90640_RawAccumulator *acc, uint16_t *frameData)
+{
+    int subPage;
+    uint8_t mode;
+    int16_t word;
+    
+    subPage = frameData[833] & 1;
+    mode = (frameData[832] & 0x1000) >> 5;
+    
+    // 65535 subpages of full scale words is as much as an int32 holds, and
+    // a changed resolution or readout mode would mix incompatible data
+    if(acc->count[subPage] == 0xFFFF || (acc->count[subPage] > 0 && acc->control[subPage] != frameData[832]))
+    {
+        return -1;
+    }
+    
+    for(int pixelNumber = 0; pixelNumber < 768; pixelNumber++)
+    {
+        if(GetPixelPattern(pixelNumber, mode) == subPage)
+        {
+            word = (int16_t)frameData[pixelNumber];
+            acc->pixels[pixelNumber] += word;
+        }
+    }
+    
+    for(int i = 0; i < 64; i++)
+    {
+        word = (int16_t)frameData[768 + i];
+        acc->aux[subPage][i] += word;
+    }
+    
+    acc->control[subPage] = frameData[832];
+    acc->count[subPage] = acc->count[subPage] + 1;
+    
+    return acc->count[subPage];
+}
+
+//------------------------------------------------------------------------------
+
+float MLX90640_GetTaAccumulated(const MLX90640_RawAccumulator *acc, const paramsMLX90640 *params)
+{
+    FrameWords words;
+    float ta = 0;
+    int n = 0;
+    
+    for(int subPage = 0; subPage < 2; subPage++)
+    {
+        if(acc->count[subPage] > 0)
+        {
+            GetAccumulatedWords(acc, subPage, &words);
+            ta += CalculateTa(&words, params);
+            n = n + 1;
+        }
+    }
+    
+    if(n == 0)
+    {
+        return 0;
+    }
+    
+    return ta / n;
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_CalculateToAccumulated(const MLX90640_RawAccumulator *acc, const paramsMLX90640 *params, float emissivity, float tr, float *result)
+{
+    FrameWords words;
+    FrameContext ctx;
+    float irData;
+    int converted = 0;
+    
+    for(int subPage = 0; subPage < 2; subPage++)
+    {
+        if(acc->count[subPage] == 0)
+        {
+            continue;
+        }
+        
+        GetAccumulatedWords(acc, subPage, &words);
+        GetFrameContext(&words, params, emissivity, tr, &ctx);
+        
+        for(int pixelNumber = 0; pixelNumber < 768; pixelNumber++)
+        {
+            if(GetPixelPattern(pixelNumber, ctx.mode) == subPage && IsPixelBad(pixelNumber, params) == 0)
+            {
+                irData = (float)acc->pixels[pixelNumber] / acc->count[subPage];
+                result[pixelNumber] = CalculatePixelTo(irData, pixelNumber, &ctx, params);
+            }
+        }
+        
+        for(int i = 0; i < params->correctionCount; i++)
+        {
+            if(GetPixelPattern(params->correction[i].pixel, ctx.mode) == subPage)
+            {
+                CorrectPixel(result, &params->correction[i], ctx.mode != 0);
+            }
+        }
+        
+        converted = converted + 1;
+    }
+    
+    return converted;
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_NucCaptureReset(MLX90640_NucCapture *capture)
+{
+    memset(capture, 0, sizeof(MLX90640_NucCapture));
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_NucCaptureFrame(MLX90640_NucCapture *capture, uint16_t *frameData)
+{
+    return MLX90640_AccumulateFrame(&capture->acc, frameData);
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_NucCapturePoint(MLX90640_NucCapture *capture, const paramsMLX90640 *params, float emissivity, float tr, float reference)
+{
+    FrameWords words;
+    FrameContext ctx;
+    float to[768];
+    float alphaCompensated;
+    float radiance;
+    float kta;
+    float kv;
+    double sum;
+    int range;
+    int point;
+    int n;
+    
+    point = capture->points;
+    if(point > 1 || capture->acc.count[0] == 0 || capture->acc.count[1] == 0)
+    {
+        return -1;
+    }
+    
+    if(reference != reference)
+    {
+        MLX90640_CalculateToAccumulated(&capture->acc, params, emissivity, tr, to);
+        sum = 0;
+        n = 0;
+        for(int pixelNumber = 0; pixelNumber < 768; pixelNumber++)
+        {
+            if(IsPixelBad(pixelNumber, params) == 0)
+            {
+                sum += to[pixelNumber];
+                n = n + 1;
+            }
+        }
+        reference = sum / n;
+    }
+    if(point == 1 && fabsf(reference - capture->reference[0]) < 1)
+    {
+        return -1;
+    }
+    
+    range = 3;
+    while(range > 0 && reference < params->ct[range])
+    {
+        range = range - 1;
+    }
+    radiance = MLX90640_TemperatureToRadiance(reference);
+    
+    for(int subPage = 0; subPage < 2; subPage++)
+    {
+        GetAccumulatedWords(&capture->acc, subPage, &words);
+        GetFrameContext(&words, params, emissivity, tr, &ctx);
+        
+        for(int pixelNumber = 0; pixelNumber < 768; pixelNumber++)
+        {
+            if(GetPixelPattern(pixelNumber, ctx.mode) != subPage)
+            {
+                continue;
+            }
+            
+            // What the pixel gives against what it should give for the
+            // reference, both as the compensated signal To is solved from
+            capture->measured[point][pixelNumber] = CompensatePixel((float)capture->acc.pixels[pixelNumber] / capture->acc.count[subPage], pixelNumber, &ctx, params, &alphaCompensated);
+            capture->target[point][pixelNumber] = alphaCompensated * ctx.alphaCorrR[range] * (1 + params->ksTo[range] * (reference - params->ct[range])) * (radiance - ctx.taTr);
+            
+            // Turns a signal offset back into calibration offset counts
+            if(point == 0)
+            {
+                kta = params->kta[pixelNumber]/ctx.ktaScale;
+                kv = params->kv[pixelNumber]/ctx.kvScale;
+                capture->offsetScale[pixelNumber] = emissivity / ((1 + kta*(ctx.ta - 25))*(1 + kv*(ctx.vdd - 3.3)));
+            }
+        }
+    }
+    
+    capture->reference[point] = reference;
+    capture->points = point + 1;
+    MLX90640_AccumulatorReset(&capture->acc);
+    
+    return point + 1;
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_NucCompute(const MLX90640_NucCapture *capture, const paramsMLX90640 *params, MLX90640_NucTable *table)
+{
+    float gain;
+    float offset;
+    
+    if(capture->points == 0)
+    {
+        return -1;
+    }
+    
+    // measured = gain * target + offset, solved per pixel
+    for(int pixelNumber = 0; pixelNumber < 768; pixelNumber++)
+    {
+        gain = 1;
+        if(capture->points > 1)
+        {
+            gain = (capture->measured[1][pixelNumber] - capture->measured[0][pixelNumber]) / (capture->target[1][pixelNumber] - capture->target[0][pixelNumber]);
+        }
+        offset = capture->measured[0][pixelNumber] - gain * capture->target[0][pixelNumber];
+        
+        // Bad pixels are replaced anyway and would only skew their table
+        if(IsPixelBad(pixelNumber, params) || !(gain >= NUC_GAIN_MIN && gain <= NUC_GAIN_MAX))
+        {
+            gain = 1;
+            offset = 0;
+        }
+        table->offset[pixelNumber] = offset * capture->offsetScale[pixelNumber];
+        table->gain[pixelNumber] = gain;
+    }
+    
+    return capture->points;
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_NucApply(paramsMLX90640 *params, const MLX90640_NucTable *table)
+{
+    float alpha;
+    float maxAlpha;
+    float scale;
+    
+    // A gain below one can push the largest alpha past 16 bits. Drop the
+    // alpha scale instead, which halves every stored alpha and leaves the
+    // compensated alpha as it was
+    maxAlpha = 0;
+    for(int pixelNumber = 0; pixelNumber < 768; pixelNumber++)
+    {
+        alpha = params->alpha[pixelNumber] / table->gain[pixelNumber];
+        if(alpha > maxAlpha)
+        {
+            maxAlpha = alpha;
+        }
+    }
+    
+    scale = 1;
+    while(maxAlpha * scale + 0.5f >= 65536 && params->alphaScale > 0)
+    {
+        params->alphaScale = params->alphaScale - 1;
+        scale = scale / 2;
+    }
+    
+    // The offset comes off the signal before the alpha division, the gain
+    // is taken out by scaling the stored reciprocal alpha
+    for(int pixelNumber = 0; pixelNumber < 768; pixelNumber++)
+    {
+        params->offset[pixelNumber] = params->offset[pixelNumber] + table->offset[pixelNumber];
+        alpha = params->alpha[pixelNumber] / table->gain[pixelNumber] * scale + 0.5f;
+        // Last resorts for a table that did not come from NucCompute: too
+        // large only once the alpha scale is down to zero, and as a divisor
+        // the stored alpha must not round to zero
+        if(alpha > 65535)
+        {
+            alpha = 65535;
+        }
+        if(alpha < 1)
+        {
+            alpha = 1;
+        }
+        params->alpha[pixelNumber] = alpha;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+static void GetAccumulatedWords(const MLX90640_RawAccumulator *acc, int subPage, FrameWords *words)
+{
+    const int32_t *aux = acc->aux[subPage];
+    float count = acc->count[subPage];
+    
+    // aux[i] is the sum of frameData[768 + i]
+    words->ptatArt = aux[0] / count;
+    words->cp[0] = aux[8] / count;
+    words->gain = aux[10] / count;
+    words->ptat = aux[32] / count;
+    words->cp[1] = aux[40] / count;
+    words->vdd = aux[42] / count;
+    words->control = acc->control[subPage];
+    words->subPage = subPage;
+}
+
+//------------------------------------------------------------------------------
+
+static void GetFrameContext(const FrameWords *words, const paramsMLX90640 *params, float emissivity, float tr, FrameContext *ctx)
+{
+    float vdd;
+    float ta;
+    float ta4;
+    float tr4;
+    float gain;
+    
+    ctx->subPage = words->subPage;
+    vdd = CalculateVdd(words, params);
+    ta = CalculateTa(words, params);
+    
+    ta4 = (ta + 273.15);
+    ta4 = ta4 * ta4;
+    ta4 = ta4 * ta4;
+    tr4 = (tr + 273.15);
+    tr4 = tr4 * tr4;
+    tr4 = tr4 * tr4;
+    ctx->taTr = tr4 - (tr4-ta4)/emissivity;
+    ctx->ta4 = ta4;
+    
+    ctx->ktaScale = pow(2,(double)params->ktaScale);
+    ctx->kvScale = pow(2,(double)params->kvScale);
+    ctx->alphaScale = pow(2,(double)params->alphaScale);
+    
+    ctx->alphaCorrR[0] = 1 / (1 + params->ksTo[0] * 40);
+    ctx->alphaCorrR[1] = 1 ;
+    ctx->alphaCorrR[2] = (1 + params->ksTo[1] * params->ct[2]);
+    ctx->alphaCorrR[3] = ctx->alphaCorrR[2] * (1 + params->ksTo[2] * (params->ct[3] - params->ct[2]));
+    for(int i = 0; i < 4; i++)
+    {
+        ctx->ctRadiance[i] = MLX90640_TemperatureToRadiance(params->ct[i]);
+    }
+    
+//------------------------- Gain calculation -----------------------------------    
+    gain = params->gainEE / words->gain; 
+  
+//------------------------- To calculation -------------------------------------    
+    ctx->mode = (words->control & 0x1000) >> 5;
+    
+    for( int i = 0; i < 2; i++)
+    {
+        ctx->irDataCP[i] = words->cp[i] * gain;
+    }
+    ctx->irDataCP[0] = ctx->irDataCP[0] - params->cpOffset[0] * (1 + params->cpKta * (ta - 25)) * (1 + params->cpKv * (vdd - 3.3));
+    if( ctx->mode ==  params->calibrationModeEE)
+    {
+        ctx->irDataCP[1] = ctx->irDataCP[1] - params->cpOffset[1] * (1 + params->cpKta * (ta - 25)) * (1 + params->cpKv * (vdd - 3.3));
+    }
+    else
+    {
+      ctx->irDataCP[1] = ctx->irDataCP[1] - (params->cpOffset[1] + params->ilChessC[0]) * (1 + params->cpKta * (ta - 25)) * (1 + params->cpKv * (vdd - 3.3));
+    }
+    
+    ctx->vdd = vdd;
+    ctx->ta = ta;
+    ctx->gain = gain;
+    ctx->emissivity = emissivity;
+}
+
+//------------------------------------------------------------------------------
+
+static void GetFrameWords(uint16_t *frameData, FrameWords *words)
+{
+    words->ptatArt = SignedWord(frameData[768]);
+    words->cp[0] = SignedWord(frameData[776]);
+    words->gain = SignedWord(frameData[778]);
+    words->ptat = SignedWord(frameData[800]);
+    words->cp[1] = SignedWord(frameData[808]);
+    words->vdd = SignedWord(frameData[810]);
+    words->control = frameData[832];
+    words->subPage = frameData[833];
+}
+
+//------------------------------------------------------------------------------
+
+static inline float SignedWord(uint16_t word)
+{
+    float value;
+    
+    value = word;
+    if(value > 32767)
+    {
+        value = value - 65536;
+    }
+    
+    return value;
+}
+
+//------------------------------------------------------------------------------
+
+static inline int GetPixelPattern(int pixelNumber, uint8_t mode)
+{
+    int ilPattern;
+    
+    ilPattern = pixelNumber / 32 - (pixelNumber / 64) * 2; 
+    if(mode == 0)
+    {
+        return ilPattern;
+    }
+    
+    return ilPattern ^ (pixelNumber - (pixelNumber/2)*2);
+}
+
+//------------------------------------------------------------------------------
+
+static inline float CompensatePixel(float irData, int pixelNumber, const FrameContext *ctx, const paramsMLX90640 *params, float *alphaCompensated)
+{
+    int8_t ilPattern;
+    int8_t conversionPattern;
+    float kta;
+    float kv;
+    
+    ilPattern = pixelNumber / 32 - (pixelNumber / 64) * 2; 
+    conversionPattern = ((pixelNumber + 2) / 4 - (pixelNumber + 3) / 4 + (pixelNumber + 1) / 4 - pixelNumber / 4) * (1 - 2 * ilPattern);
+    
+    irData = irData * ctx->gain;
+    
+    kta = params->kta[pixelNumber]/ctx->ktaScale;
+    kv = params->kv[pixelNumber]/ctx->kvScale;
+    irData = irData - params->offset[pixelNumber]*(1 + kta*(ctx->ta - 25))*(1 + kv*(ctx->vdd - 3.3));
+    
+    if(ctx->mode !=  params->calibrationModeEE)
+    {
+      irData = irData + params->ilChessC[2] * (2 * ilPattern - 1) - params->ilChessC[1] * conversionPattern; 
+    }                       
+
+    irData = irData - params->tgc * ctx->irDataCP[ctx->subPage];
+    irData = irData / ctx->emissivity;
+    
+    *alphaCompensated = SCALEALPHA*ctx->alphaScale/params->alpha[pixelNumber];
+    *alphaCompensated = *alphaCompensated*(1 + params->KsTa * (ctx->ta - 25));
+    
+    return irData;
+}
+
+//------------------------------------------------------------------------------
+
+static inline float CalculatePixelTo(float irData, int pixelNumber, const FrameContext *ctx, const paramsMLX90640 *params)
+{
+    float alphaCompensated;
+    
+    irData = CompensatePixel(irData, pixelNumber, ctx, params, &alphaCompensated);
+    
+    return SolvePixelTo(irData, alphaCompensated, ctx->taTr, ctx, params);
+}
+
+//------------------------------------------------------------------------------
+
+static inline float SolvePixelTo(float irData, float alphaCompensated, float taTr, const FrameContext *ctx, const paramsMLX90640 *params)
+{
+    float Sx;
+    float To;
+    int8_t range;
+                
+    Sx = alphaCompensated * alphaCompensated * alphaCompensated * (irData + alphaCompensated * taTr);
+    Sx = sqrt(sqrt(Sx)) * params->ksTo[1];            
+    
+    To = sqrt(sqrt(irData/(alphaCompensated * (1 - params->ksTo[1] * 273.15) + Sx) + taTr)) - 273.15;                     
+            
+    if(To < params->ct[1])
+    {
+        range = 0;
+    }
+    else if(To < params->ct[2])   
+    {
+        range = 1;            
+    }   
+    else if(To < params->ct[3])
+    {
+        range = 2;            
+    }
+    else
+    {
+        range = 3;            
+    }      
+    
+    To = sqrt(sqrt(irData / (alphaCompensated * ctx->alphaCorrR[range] * (1 + params->ksTo[range] * (To - params->ct[range]))) + taTr)) - 273.15;
+    
+    return To;
+}
+
+//------------------------------------------------------------------------------
+
+static inline float CalculatePixelRadiance(float irData, int pixelNumber, const FrameContext *ctx, const paramsMLX90640 *params)
+{
+    float alphaCompensated;
+    float Sx;
+    float radiance;
+    float To;
+    int8_t range;
+    
+    irData = CompensatePixel(irData, pixelNumber, ctx, params, &alphaCompensated);
+    
+    // Same steps as CalculatePixelTo. The first estimate only picks the
+    // range and feeds the small ksTo terms, so its roots can be approximate,
+    // and the final root is left to the caller.
+    Sx = alphaCompensated * alphaCompensated * alphaCompensated * (irData + alphaCompensated * ctx->taTr);
+    Sx = FastRoot4(Sx) * params->ksTo[1];
+    
+    radiance = irData/(alphaCompensated * (1 - params->ksTo[1] * 273.15f) + Sx) + ctx->taTr;
+    
+    if(radiance < ctx->ctRadiance[1])
+    {
+        range = 0;
+    }
+    else if(radiance < ctx->ctRadiance[2])
+    {
+        range = 1;
+    }
+    else if(radiance < ctx->ctRadiance[3])
+    {
+        range = 2;
+    }
+    else
+    {
+        range = 3;
+    }
+    
+    To = FastRoot4(radiance) - 273.15f;
+    
+    return irData / (alphaCompensated * ctx->alphaCorrR[range] * (1 + params->ksTo[range] * (To - params->ct[range]))) + ctx->taTr;
+}
+
+//------------------------------------------------------------------------------
+
+static inline float FastRoot4(float x)
+{
+    uint32_t bits;
+    float y;
+    
+    if(!(x > 0))
+    {
+        return (x == 0) ? 0 : NAN;
+    }
+    
+    // A quarter of the exponent from the bits, then two Newton steps
+    memcpy(&bits, &x, sizeof(bits));
+    bits = 0x2FA00000 + (bits >> 2);
+    memcpy(&y, &bits, sizeof(y));
+    
+    y = 0.75f * y + 0.25f * x / (y * y * y);
+    return 0.75f * y + 0.25f * x / (y * y * y);
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_GetImage(uint16_t *frameData, const paramsMLX90640 *params, float *result)
+{
+    float vdd;
+    float ta;
+    float gain;
+    float irDataCP[2];
+    float irData;
+    float alphaCompensated;
+    uint8_t mode;
     int8_t ilPattern;
     int8_t chessPattern;
     int8_t pattern;
@@ -658,19 +1731,37 @@ void MLX90640_GetImage(uint16_t *frameData, const paramsMLX90640 *params, float
 
 //------------------------------------------------------------------------------
 
-float MLX90640_GetVdd(uint16_t *frameData, const paramsMLX90640 *params)
+float MLX90640_GetVdd(uint16_t *frameData, const paramsMLX90640 *params)
+{
+    FrameWords words;
+    
+    GetFrameWords(frameData, &words);
+    
+    return CalculateVdd(&words, params);
+}
+
+//------------------------------------------------------------------------------
+
+float MLX90640_GetTa(uint16_t *frameData, const paramsMLX90640 *params)
+{
+    FrameWords words;
+    
+    GetFrameWords(frameData, &words);
+    
+    return CalculateTa(&words, params);
+}
+
+//------------------------------------------------------------------------------
+
+static float CalculateVdd(const FrameWords *words, const paramsMLX90640 *params)
 {
     float vdd;
     float resolutionCorrection;
 
     int resolutionRAM;    
     
-    vdd = frameData[810];
-    if(vdd > 32767)
-    {
-        vdd = vdd - 65536;
-    }
-    resolutionRAM = (frameData[832] & 0x0C00) >> 10;
+    vdd = words->vdd;
+    resolutionRAM = (words->control & 0x0C00) >> 10;
     resolutionCorrection = pow(2, (double)params->resolutionEE) / pow(2, (double)resolutionRAM);
     vdd = (resolutionCorrection * vdd - params->vdd25) / params->kVdd + 3.3;
     
@@ -679,26 +1770,17 @@ float MLX90640_GetVdd(uint16_t *frameData, const paramsMLX90640 *params)
 
 //------------------------------------------------------------------------------
 
-float MLX90640_GetTa(uint16_t *frameData, const paramsMLX90640 *params)
+static float CalculateTa(const FrameWords *words, const paramsMLX90640 *params)
 {
     float ptat;
     float ptatArt;
     float vdd;
     float ta;
     
-    vdd = MLX90640_GetVdd(frameData, params);
-    
-    ptat = frameData[800];
-    if(ptat > 32767)
-    {
-        ptat = ptat - 65536;
-    }
+    vdd = CalculateVdd(words, params);
     
-    ptatArt = frameData[768];
-    if(ptatArt > 32767)
-    {
-        ptatArt = ptatArt - 65536;
-    }
+    ptat = words->ptat;
+    ptatArt = words->ptatArt;
     ptatArt = (ptat / (ptat * params->alphaPTAT + ptatArt)) * pow(2, (double)18);
     
     ta = (ptatArt / (1 + params->KvPTAT * (vdd - 3.3)) - params->vPTAT25);
@@ -719,7 +1801,7 @@ int MLX90640_GetSubPageNumber(uint16_t *frameData)
 void MLX90640_BadPixelsCorrection(uint16_t *pixels, float *to, int mode, paramsMLX90640 *params)
 {   
     float ap[4];
-    uint8_t pix;
+    uint16_t pix;
     uint8_t line;
     uint8_t column;
     
@@ -819,6 +1901,174 @@ void MLX90640_BadPixelsCorrection(uint16_t *pixels, float *to, int mode, paramsM
 
 //------------------------------------------------------------------------------
 
+void MLX90640_CorrectPixels(float *to, int mode, const paramsMLX90640 *params)
+{
+    mode = (mode != 0);
+    for(int i = 0; i < params->correctionCount; i++)
+    {
+        CorrectPixel(to, &params->correction[i], mode);
+    }
+}
+
+//------------------------------------------------------------------------------
+
+static inline void CorrectPixel(float *to, const MLX90640_PixelCorrection *correction, int mode)
+{
+    const int8_t *offset = correction->offset[mode];
+    float *pixel = to + correction->pixel;
+    float ap[4];
+    float lo;
+    float hi;
+    
+    switch(correction->method[mode])
+    {
+        case MLX90640_CORRECT_COPY:
+            pixel[0] = pixel[offset[0]];
+            break;
+        case MLX90640_CORRECT_MEAN2:
+            pixel[0] = (pixel[offset[0]] + pixel[offset[1]])/2.0;
+            break;
+        case MLX90640_CORRECT_MEDIAN4:
+            // The middle two of four values are the larger of the pair minima
+            // and the smaller of the pair maxima
+            ap[0] = pixel[offset[0]];
+            ap[1] = pixel[offset[1]];
+            ap[2] = pixel[offset[2]];
+            ap[3] = pixel[offset[3]];
+            lo = (ap[0] < ap[1]) ? ap[0] : ap[1];
+            hi = (ap[2] < ap[3]) ? ap[2] : ap[3];
+            lo = (lo > hi) ? lo : hi;
+            hi = (ap[0] > ap[1]) ? ap[0] : ap[1];
+            ap[3] = (ap[2] > ap[3]) ? ap[2] : ap[3];
+            hi = (hi < ap[3]) ? hi : ap[3];
+            pixel[0] = (hi + lo)/2.0;
+            break;
+        case MLX90640_CORRECT_GRADIENT:
+            ap[0] = pixel[offset[0]] - pixel[offset[1]];
+            ap[1] = pixel[offset[2]] - pixel[offset[3]];
+            if(fabs(ap[0]) > fabs(ap[1]))
+            {
+                pixel[0] = pixel[offset[2]] + ap[1];
+            }
+            else
+            {
+                pixel[0] = pixel[offset[0]] + ap[0];
+            }
+            break;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_PixelMonitorInit(MLX90640_PixelMonitor *monitor)
+{
+    memset(monitor, 0, sizeof(MLX90640_PixelMonitor));
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_PixelMonitorUpdate(MLX90640_PixelMonitor *monitor, uint16_t *frameData, const float *to, paramsMLX90640 *params)
+{
+    uint16_t subPage;
+    uint8_t mode;
+    int column;
+    int left;
+    int right;
+    float delta;
+    float residual;
+    float stuckLimit;
+    float noiseLimit;
+    float activitySum;
+    float varSum;
+    int nPixels;
+    int nVar;
+    int promoted;
+    int noisy;
+    
+    subPage = frameData[833];
+    mode = (frameData[832] & 0x1000) >> 5;
+    
+    // Limits come from the previous update so one pass is enough
+    stuckLimit = MONITOR_STUCK_RATIO * monitor->globalActivity;
+    noiseLimit = MONITOR_NOISE_RATIO * monitor->globalVar;
+    
+    activitySum = 0;
+    varSum = 0;
+    nPixels = 0;
+    nVar = 0;
+    promoted = 0;
+    for(int pixelNumber = 0; pixelNumber < 768; pixelNumber++)
+    {
+        if(GetPixelPattern(pixelNumber, mode) != subPage || IsPixelBad(pixelNumber, params))
+        {
+            continue;
+        }
+        
+        delta = fabsf(to[pixelNumber] - monitor->last[pixelNumber]);
+        monitor->last[pixelNumber] = to[pixelNumber];
+        if(monitor->updates < 2)
+        {
+            continue;
+        }
+        
+        monitor->activity[pixelNumber] += MONITOR_ALPHA * (delta - monitor->activity[pixelNumber]);
+        activitySum += monitor->activity[pixelNumber];
+        nPixels = nPixels + 1;
+        
+        // Residual against the horizontal neighbours, skipped when one of
+        // them is a corrected pixel and so partly a copy of this one
+        column = pixelNumber & 31;
+        left = (column == 0) ? pixelNumber + 1 : pixelNumber - 1;
+        right = (column == 31) ? pixelNumber - 1 : pixelNumber + 1;
+        if(IsPixelBad(left, params) == 0 && IsPixelBad(right, params) == 0)
+        {
+            residual = to[pixelNumber] - 0.5f * (to[left] + to[right]);
+            monitor->residualMean[pixelNumber] += MONITOR_ALPHA * (residual - monitor->residualMean[pixelNumber]);
+            residual = residual - monitor->residualMean[pixelNumber];
+            monitor->residualVar[pixelNumber] += MONITOR_ALPHA * (residual * residual - monitor->residualVar[pixelNumber]);
+            varSum += monitor->residualVar[pixelNumber];
+            nVar = nVar + 1;
+        }
+        
+        if(monitor->updates < MONITOR_WARMUP)
+        {
+            continue;
+        }
+        
+        // A noisy pixel also raises the residual of its neighbours, but only
+        // to about a quarter of its own
+        noisy = monitor->residualVar[pixelNumber] > noiseLimit &&
+                monitor->residualVar[pixelNumber] > 2 * monitor->residualVar[left] &&
+                monitor->residualVar[pixelNumber] > 2 * monitor->residualVar[right];
+        if(monitor->activity[pixelNumber] < stuckLimit || noisy)
+        {
+            monitor->strikes[pixelNumber] = monitor->strikes[pixelNumber] + 1;
+            if(monitor->strikes[pixelNumber] >= MONITOR_STRIKES)
+            {
+                promoted += MLX90640_AddBadPixel(params, pixelNumber);
+            }
+        }
+        else if(monitor->strikes[pixelNumber] > 0)
+        {
+            monitor->strikes[pixelNumber] = monitor->strikes[pixelNumber] - 1;
+        }
+    }
+    
+    if(nPixels > 0)
+    {
+        monitor->globalActivity = activitySum / nPixels;
+    }
+    if(nVar > 0)
+    {
+        monitor->globalVar = varSum / nVar;
+    }
+    monitor->updates = monitor->updates + 1;
+    
+    return promoted;
+}
+
+//------------------------------------------------------------------------------
+
 void ExtractVDDParameters(uint16_t *eeData, paramsMLX90640 *mlx90640)
 {
     int16_t kVdd;
@@ -1438,14 +2688,9 @@ int ExtractDeviatingPixels(uint16_t *eeData, paramsMLX90640 *mlx90640)
     int warn = 0;
     int i;
     
-    for(pixCnt = 0; pixCnt<5; pixCnt++)
-    {
-        mlx90640->brokenPixels[pixCnt] = 0xFFFF;
-        mlx90640->outlierPixels[pixCnt] = 0xFFFF;
-    }
-        
-    pixCnt = 0;    
-    while (pixCnt < 768 && brokenPixCnt < 5 && outlierPixCnt < 5)
+    memset(mlx90640->badPixelMask, 0, sizeof(mlx90640->badPixelMask));
+    
+    for(pixCnt = 0; pixCnt < 768; pixCnt++)
     {
         if(eeData[pixCnt+64] == 0)
         {
@@ -1456,65 +2701,58 @@ int ExtractDeviatingPixels(uint16_t *eeData, paramsMLX90640 *mlx90640)
         {
             mlx90640->outlierPixels[outlierPixCnt] = pixCnt;
             outlierPixCnt = outlierPixCnt + 1;
-        }    
-        
-        pixCnt = pixCnt + 1;
+        }
+        else
+        {
+            continue;
+        }
         
+        mlx90640->badPixelMask[pixCnt>>3] |= 1 << (pixCnt & 7);
     } 
     
-    if(brokenPixCnt > 4)  
-    {
-        warn = -3;
-    }         
-    else if(outlierPixCnt > 4)  
-    {
-        warn = -4;
-    }
-    else if((brokenPixCnt + outlierPixCnt) > 4)  
-    {
-        warn = -5;
-    } 
-    else
+    mlx90640->brokenPixels[brokenPixCnt] = 0xFFFF;
+    mlx90640->outlierPixels[outlierPixCnt] = 0xFFFF;
+    mlx90640->brokenPixelCount = brokenPixCnt;
+    mlx90640->outlierPixelCount = outlierPixCnt;
+    
+    // Adjacent bad pixels are still corrected, the plan routes around them,
+    // but the result is less accurate so it is reported
+    for(pixCnt=0; pixCnt<brokenPixCnt; pixCnt++)
     {
-        for(pixCnt=0; pixCnt<brokenPixCnt; pixCnt++)
+        for(i=pixCnt+1; i<brokenPixCnt; i++)
         {
-            for(i=pixCnt+1; i<brokenPixCnt; i++)
+            warn = CheckAdjacentPixels(mlx90640->brokenPixels[pixCnt],mlx90640->brokenPixels[i]);
+            if(warn != 0)
             {
-                warn = CheckAdjacentPixels(mlx90640->brokenPixels[pixCnt],mlx90640->brokenPixels[i]);
-                if(warn != 0)
-                {
-                    return warn;
-                }    
+                return warn;
             }    
-        }
-        
-        for(pixCnt=0; pixCnt<outlierPixCnt; pixCnt++)
+        }    
+    }
+    
+    for(pixCnt=0; pixCnt<outlierPixCnt; pixCnt++)
+    {
+        for(i=pixCnt+1; i<outlierPixCnt; i++)
         {
-            for(i=pixCnt+1; i<outlierPixCnt; i++)
+            warn = CheckAdjacentPixels(mlx90640->outlierPixels[pixCnt],mlx90640->outlierPixels[i]);
+            if(warn != 0)
             {
-                warn = CheckAdjacentPixels(mlx90640->outlierPixels[pixCnt],mlx90640->outlierPixels[i]);
-                if(warn != 0)
-                {
-                    return warn;
-                }    
+                return warn;
             }    
-        } 
-        
-        for(pixCnt=0; pixCnt<brokenPixCnt; pixCnt++)
+        }    
+    } 
+    
+    for(pixCnt=0; pixCnt<brokenPixCnt; pixCnt++)
+    {
+        for(i=0; i<outlierPixCnt; i++)
         {
-            for(i=0; i<outlierPixCnt; i++)
+            warn = CheckAdjacentPixels(mlx90640->brokenPixels[pixCnt],mlx90640->outlierPixels[i]);
+            if(warn != 0)
             {
-                warn = CheckAdjacentPixels(mlx90640->brokenPixels[pixCnt],mlx90640->outlierPixels[i]);
-                if(warn != 0)
-                {
-                    return warn;
-                }    
+                return warn;
             }    
         }    
-        
     }    
     
-    
     return warn;
        
 }
@@ -1575,17 +2813,285 @@ float GetMedian(float *values, int n)
 
 //------------------------------------------------------------------------------
 
-int IsPixelBad(uint16_t pixel,paramsMLX90640 *params)
+int IsPixelBad(uint16_t pixel,const paramsMLX90640 *params)
+{
+    if(pixel > 767)
+    {
+        return 0;
+    }
+    
+    return (params->badPixelMask[pixel>>3] >> (pixel & 7)) & 1;     
+}     
+
+//------------------------------------------------------------------------------
+
+void BuildCorrectionPlan(paramsMLX90640 *mlx90640)
+{
+    uint16_t *lists[2] = {mlx90640->brokenPixels, mlx90640->outlierPixels};
+    uint8_t planned[96];
+    uint16_t pixel;
+    
+    // Broken pixels first, outliers after, the order BadPixelsCorrection was
+    // always called in, then anything else set in the mask
+    memset(planned, 0, sizeof(planned));
+    mlx90640->correctionCount = 0;
+    for(int l = 0; l < 2; l++)
+    {
+        for(int i = 0; lists[l][i] != 0xFFFF; i++)
+        {
+            pixel = lists[l][i];
+            PlanPixelCorrection(pixel, mlx90640, &mlx90640->correction[mlx90640->correctionCount]);
+            mlx90640->correctionCount = mlx90640->correctionCount + 1;
+            planned[pixel>>3] |= 1 << (pixel & 7);
+        }
+    }
+    
+    for(pixel = 0; pixel < 768; pixel++)
+    {
+        if(IsPixelBad(pixel, mlx90640) && (planned[pixel>>3] & (1 << (pixel & 7))) == 0)
+        {
+            PlanPixelCorrection(pixel, mlx90640, &mlx90640->correction[mlx90640->correctionCount]);
+            mlx90640->correctionCount = mlx90640->correctionCount + 1;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void BuildRawRepairPlan(paramsMLX90640 *mlx90640)
+{
+    MLX90640_RawRepair *repair;
+    uint16_t x;
+    
+    // Same neighbours, in the same order, as MLX90640_InterpolateOutliers
+    mlx90640->rawRepairCount = 0;
+    for(int i = 0; mlx90640->brokenPixels[i] != 0xFFFF; i++)
+    {
+        x = mlx90640->brokenPixels[i];
+        repair = &mlx90640->rawRepair[mlx90640->rawRepairCount];
+        repair->pixel = x;
+        repair->count = 0;
+        if(x > 33)
+        {
+            repair->offset[repair->count++] = -33;
+            repair->offset[repair->count++] = -31;
+        }
+        else if(x > 31)
+        {
+            repair->offset[repair->count++] = -31;
+        }
+        if(x + 33 < 768)
+        {
+            repair->offset[repair->count++] = 33;
+            repair->offset[repair->count++] = 31;
+        }
+        else if(x + 31 < 768)
+        {
+            repair->offset[repair->count++] = 31;
+        }
+        mlx90640->rawRepairCount = mlx90640->rawRepairCount + 1;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_AddBadPixel(paramsMLX90640 *params, uint16_t pixel)
+{
+    if(pixel > 767)
+    {
+        return -1;
+    }
+    
+    if(IsPixelBad(pixel, params))
+    {
+        return 0;
+    }
+    
+    // A pixel found at runtime is treated as broken, so the raw repair and
+    // BadPixelsCorrection see it too. The mask check above keeps the list
+    // within one entry per pixel
+    params->brokenPixels[params->brokenPixelCount] = pixel;
+    params->brokenPixelCount = params->brokenPixelCount + 1;
+    params->brokenPixels[params->brokenPixelCount] = 0xFFFF;
+    params->badPixelMask[pixel>>3] |= 1 << (pixel & 7);
+    
+    // Neighbouring entries may have used this pixel, so replan all of them
+    BuildCorrectionPlan(params);
+    BuildRawRepairPlan(params);
+    
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+
+static void PlanPixelCorrection(uint16_t pixel, paramsMLX90640 *params, MLX90640_PixelCorrection *correction)
+{
+    uint8_t line;
+    uint8_t column;
+    
+    line = pixel>>5;
+    column = pixel - (line<<5);
+    correction->pixel = pixel;
+    
+//------------------------- Chess mode -----------------------------------------
+    if(line == 0)
+    {
+        if(column == 0)
+        {
+            SetCorrection(correction, 1, MLX90640_CORRECT_COPY, 33, 0, 0, 0);
+        }
+        else if(column == 31)
+        {
+            SetCorrection(correction, 1, MLX90640_CORRECT_COPY, 31, 0, 0, 0);
+        }
+        else
+        {
+            SetCorrection(correction, 1, MLX90640_CORRECT_MEAN2, 31, 33, 0, 0);
+        }
+    }
+    else if(line == 23)
+    {
+        if(column == 0)
+        {
+            SetCorrection(correction, 1, MLX90640_CORRECT_COPY, -31, 0, 0, 0);
+        }
+        else if(column == 31)
+        {
+            SetCorrection(correction, 1, MLX90640_CORRECT_COPY, -33, 0, 0, 0);
+        }
+        else
+        {
+            SetCorrection(correction, 1, MLX90640_CORRECT_MEAN2, -33, -31, 0, 0);
+        }
+    }
+    else if(column == 0)
+    {
+        SetCorrection(correction, 1, MLX90640_CORRECT_MEAN2, -31, 33, 0, 0);
+    }
+    else if(column == 31)
+    {
+        SetCorrection(correction, 1, MLX90640_CORRECT_MEAN2, -33, 31, 0, 0);
+    }
+    else
+    {
+        SetCorrection(correction, 1, MLX90640_CORRECT_MEDIAN4, -33, -31, 31, 33);
+    }
+    
+//------------------------- Interleaved mode -----------------------------------
+    if(column == 0)
+    {
+        SetCorrection(correction, 0, MLX90640_CORRECT_COPY, 1, 0, 0, 0);
+    }
+    else if(column == 1 || column == 30)
+    {
+        SetCorrection(correction, 0, MLX90640_CORRECT_MEAN2, -1, 1, 0, 0);
+    }
+    else if(column == 31)
+    {
+        SetCorrection(correction, 0, MLX90640_CORRECT_COPY, -1, 0, 0, 0);
+    }
+    else if(IsPixelBad(pixel-2,params) == 0 && IsPixelBad(pixel+2,params) == 0)
+    {
+        SetCorrection(correction, 0, MLX90640_CORRECT_GRADIENT, 1, 2, -1, -2);
+    }
+    else
+    {
+        SetCorrection(correction, 0, MLX90640_CORRECT_MEAN2, -1, 1, 0, 0);
+    }
+    
+    for(int mode = 0; mode < 2; mode++)
+    {
+        if(UsesBadNeighbour(correction, mode, params))
+        {
+            PlanFallbackCorrection(correction, mode, params);
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+
+static int UsesBadNeighbour(const MLX90640_PixelCorrection *correction, int mode, paramsMLX90640 *params)
 {
-    for(int i=0; i<5; i++)
+    int used;
+    
+    used = 4;
+    if(correction->method[mode] == MLX90640_CORRECT_COPY)
+    {
+        used = 1;
+    }
+    else if(correction->method[mode] == MLX90640_CORRECT_MEAN2)
+    {
+        used = 2;
+    }
+    
+    for(int i = 0; i < used; i++)
     {
-        if(pixel == params->outlierPixels[i] || pixel == params->brokenPixels[i])
+        if(IsPixelBad(correction->pixel + correction->offset[mode][i], params))
         {
             return 1;
-        }    
-    }   
+        }
+    }
     
-    return 0;     
-}     
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+
+static void PlanFallbackCorrection(MLX90640_PixelCorrection *correction, int mode, paramsMLX90640 *params)
+{
+    // Neighbours in the same subpage as the pixel, nearest first, as
+    // {line, column} steps
+    static const int8_t interleavedSteps[8][2] = {{0,-1}, {0,1}, {0,-2}, {0,2}, {0,-3}, {0,3}, {-2,0}, {2,0}};
+    static const int8_t chessSteps[8][2] = {{-1,-1}, {-1,1}, {1,-1}, {1,1}, {0,-2}, {0,2}, {-2,0}, {2,0}};
+    const int8_t (*steps)[2];
+    int8_t good[2];
+    int nGood;
+    int line;
+    int column;
+    
+    steps = mode ? chessSteps : interleavedSteps;
+    line = correction->pixel>>5;
+    column = correction->pixel - (line<<5);
+    
+    nGood = 0;
+    for(int i = 0; i < 8 && nGood < 2; i++)
+    {
+        if(line + steps[i][0] < 0 || line + steps[i][0] > 23 || column + steps[i][1] < 0 || column + steps[i][1] > 31)
+        {
+            continue;
+        }
+        
+        if(IsPixelBad(correction->pixel + 32 * steps[i][0] + steps[i][1], params) == 0)
+        {
+            good[nGood] = 32 * steps[i][0] + steps[i][1];
+            nGood = nGood + 1;
+        }
+    }
+    
+    if(nGood == 2)
+    {
+        SetCorrection(correction, mode, MLX90640_CORRECT_MEAN2, good[0], good[1], 0, 0);
+    }
+    else if(nGood == 1)
+    {
+        SetCorrection(correction, mode, MLX90640_CORRECT_COPY, good[0], 0, 0, 0);
+    }
+    else
+    {
+        // Nothing usable nearby, leave the value alone
+        SetCorrection(correction, mode, MLX90640_CORRECT_COPY, 0, 0, 0, 0);
+    }
+}
+
+//------------------------------------------------------------------------------
+
+static void SetCorrection(MLX90640_PixelCorrection *correction, int mode, uint8_t method, int8_t offset0, int8_t offset1, int8_t offset2, int8_t offset3)
+{
+    correction->method[mode] = method;
+    correction->offset[mode][0] = offset0;
+    correction->offset[mode][1] = offset1;
+    correction->offset[mode][2] = offset2;
+    correction->offset[mode][3] = offset3;
+}
 
 //------------------------------------------------------------------------------
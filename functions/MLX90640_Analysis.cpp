@@ -0,0 +1,976 @@
+/**
+ * @copyright (C) 2017 Melexis N.V.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <MLX90640_Analysis.h>
+#include "MLX90640_SIMD.h"
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+// Every track-blob pair can be a candidate match
+#define MAX_PAIRS (MLX90640_MAX_TRACKS * MLX90640_MAX_BLOBS)
+
+// A new provisional label needs its west neighbour in the background, so a
+// row can start at most 16 of them
+#define MAX_PROVISIONAL 384
+
+typedef struct
+    {
+        float sum;
+        float weight;
+        float x;
+        float y;
+        float peak;
+        uint16_t area;
+        uint16_t peakPixel;
+        uint8_t left;
+        uint8_t right;
+        uint8_t top;
+        uint8_t bottom;
+    } BlobSums;
+
+static inline uint16_t FindRoot(uint16_t *parent, uint16_t label);
+static inline void AddPixel(BlobSums *sums, int pixel, float to, float weight);
+static void MergeSums(BlobSums *into, const BlobSums *from);
+static float FrameMedian(const float *to);
+static void StartTrack(MLX90640_Tracker *tracker, MLX90640_Track *track, const MLX90640_Blob *blob, int index);
+static int CompareBackground(MLX90640_ChangeDetector *detector, uint16_t *frameData, const float *values);
+
+//------------------------------------------------------------------------------
+
+int MLX90640_FrameStatsInit(MLX90640_FrameStats *stats, float histMin, float histMax)
+{
+    if(!(histMax > histMin))
+    {
+        return -1;
+    }
+
+    memset(stats, 0, sizeof(MLX90640_FrameStats));
+    stats->histMin = histMin;
+    stats->binWidth = (histMax - histMin) / MLX90640_HISTOGRAM_BINS;
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_GetFrameStats(MLX90640_FrameStats *stats, const float *to, int n)
+{
+    int32_t bin[4];
+    simd4f v;
+    simd4f valid;
+    simd4f sum;
+    simd4f count;
+    simd4f low;
+    simd4f high;
+    simd4f scale;
+    simd4f offset;
+    simd4f zero;
+    simd4f top;
+    simd4f discard;
+    float lanes[4];
+    float t;
+    int i;
+
+    memset(stats->histogram, 0, sizeof(stats->histogram));
+
+    sum = simd4f_set1(0);
+    count = simd4f_set1(0);
+    low = simd4f_set1(FLT_MAX);
+    high = simd4f_set1(-FLT_MAX);
+    scale = simd4f_set1(1.0f / stats->binWidth);
+    offset = simd4f_set1(-stats->histMin / stats->binWidth);
+    zero = simd4f_set1(0);
+    top = simd4f_set1(MLX90640_HISTOGRAM_BINS - 0.5f);
+    discard = simd4f_set1(MLX90640_HISTOGRAM_BINS);
+
+    // NaNs fail the self compare, they are left out of the sums and go to
+    // the spare bin past the end
+    for(i = 0; i + 4 <= n; i += 4)
+    {
+        v = simd4f_load(to + i);
+        valid = simd4f_le(v, v);
+        sum = simd4f_add(sum, simd4f_and(valid, v));
+        count = simd4f_add(count, simd4f_and(valid, simd4f_set1(1.0f)));
+        low = simd4f_min(simd4f_select(valid, v, low), low);
+        high = simd4f_max(simd4f_select(valid, v, high), high);
+
+        v = simd4f_min(simd4f_max(simd4f_add(simd4f_mul(v, scale), offset), zero), top);
+        simd4f_store_int(bin, simd4f_select(valid, v, discard));
+        stats->histogram[bin[0]]++;
+        stats->histogram[bin[1]]++;
+        stats->histogram[bin[2]]++;
+        stats->histogram[bin[3]]++;
+    }
+
+    simd4f_store(lanes, sum);
+    stats->mean = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    simd4f_store(lanes, count);
+    stats->count = (uint32_t)lanes[0] + (uint32_t)lanes[1] + (uint32_t)lanes[2] + (uint32_t)lanes[3];
+    simd4f_store(lanes, low);
+    stats->min = fminf(fminf(lanes[0], lanes[1]), fminf(lanes[2], lanes[3]));
+    simd4f_store(lanes, high);
+    stats->max = fmaxf(fmaxf(lanes[0], lanes[1]), fmaxf(lanes[2], lanes[3]));
+
+    for(; i < n; i++)
+    {
+        if(isnan(to[i]))
+        {
+            continue;
+        }
+        stats->mean += to[i];
+        stats->count++;
+        stats->min = fminf(stats->min, to[i]);
+        stats->max = fmaxf(stats->max, to[i]);
+        t = (to[i] - stats->histMin) / stats->binWidth;
+        stats->histogram[(t > 0) ? ((t < MLX90640_HISTOGRAM_BINS - 0.5f) ? (int)t : MLX90640_HISTOGRAM_BINS - 1) : 0]++;
+    }
+
+    if(stats->count == 0)
+    {
+        stats->mean = NAN;
+        stats->min = NAN;
+        stats->max = NAN;
+        return;
+    }
+    stats->mean = stats->mean / stats->count;
+}
+
+//------------------------------------------------------------------------------
+
+float MLX90640_GetPercentile(const MLX90640_FrameStats *stats, float fraction)
+{
+    float target;
+    float value;
+    uint32_t cumulative;
+    int b;
+
+    if(stats->count == 0)
+    {
+        return NAN;
+    }
+    if(fraction <= 0)
+    {
+        return stats->min;
+    }
+    if(fraction >= 1)
+    {
+        return stats->max;
+    }
+
+    target = fraction * stats->count;
+    cumulative = 0;
+    for(b = 0; b < MLX90640_HISTOGRAM_BINS - 1; b++)
+    {
+        if(cumulative + stats->histogram[b] >= target)
+        {
+            break;
+        }
+        cumulative += stats->histogram[b];
+    }
+
+    value = stats->histMin + stats->binWidth * b;
+    if(stats->histogram[b] > 0)
+    {
+        value += stats->binWidth * (target - cumulative) / stats->histogram[b];
+    }
+
+    // The end bins also hold everything outside the histogram range
+    if(value < stats->min)
+    {
+        value = stats->min;
+    }
+    if(value > stats->max)
+    {
+        value = stats->max;
+    }
+
+    return value;
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_AutoRangeInit(MLX90640_AutoRange *range)
+{
+    memset(range, 0, sizeof(MLX90640_AutoRange));
+    range->lowPercentile = 0.02f;
+    range->highPercentile = 0.98f;
+    range->minSpan = 4.0f;
+    range->smoothing = 0.2f;
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_AutoRangeUpdate(MLX90640_AutoRange *range, const MLX90640_FrameStats *stats)
+{
+    float low;
+    float high;
+    float centre;
+
+    if(stats->count == 0)
+    {
+        return;
+    }
+
+    low = MLX90640_GetPercentile(stats, range->lowPercentile);
+    high = MLX90640_GetPercentile(stats, range->highPercentile);
+    if(high - low < range->minSpan)
+    {
+        centre = 0.5f * (low + high);
+        low = centre - 0.5f * range->minSpan;
+        high = centre + 0.5f * range->minSpan;
+    }
+
+    if(range->primed == 0)
+    {
+        range->minTemp = low;
+        range->maxTemp = high;
+        range->primed = 1;
+        return;
+    }
+
+    range->minTemp += range->smoothing * (low - range->minTemp);
+    range->maxTemp += range->smoothing * (high - range->maxTemp);
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_FindBlobs(const float *to, int mode, float threshold, int minArea, MLX90640_BlobList *blobs)
+{
+    uint16_t provisional[768];
+    uint16_t parent[MAX_PROVISIONAL + 1];
+    BlobSums sums[MAX_PROVISIONAL + 1];
+    uint8_t final[MAX_PROVISIONAL + 1];
+    MLX90640_Blob blob;
+    uint16_t neighbour[4];
+    uint16_t label;
+    uint16_t root;
+    float level;
+    int labels;
+    int n;
+    int k;
+
+    level = threshold;
+    if(mode == MLX90640_THRESHOLD_RELATIVE)
+    {
+        level += FrameMedian(to);
+    }
+    blobs->level = level;
+    blobs->count = 0;
+
+    // Label 0 is the background, provisional labels start at 1
+    labels = 0;
+    for(int y = 0; y < 24; y++)
+    {
+        for(int x = 0; x < 32; x++)
+        {
+            k = 32 * y + x;
+            if(!(to[k] > level))
+            {
+                provisional[k] = 0;
+                continue;
+            }
+
+            // Already scanned 8-neighbours: W, NW, N, NE
+            n = 0;
+            if(x > 0 && provisional[k - 1] != 0)
+            {
+                neighbour[n++] = provisional[k - 1];
+            }
+            if(y > 0)
+            {
+                if(x > 0 && provisional[k - 33] != 0)
+                {
+                    neighbour[n++] = provisional[k - 33];
+                }
+                if(provisional[k - 32] != 0)
+                {
+                    neighbour[n++] = provisional[k - 32];
+                }
+                if(x < 31 && provisional[k - 31] != 0)
+                {
+                    neighbour[n++] = provisional[k - 31];
+                }
+            }
+
+            if(n == 0)
+            {
+                labels = labels + 1;
+                label = labels;
+                parent[label] = label;
+                memset(&sums[label], 0, sizeof(BlobSums));
+                sums[label].peak = -FLT_MAX;
+                sums[label].left = x;
+                sums[label].right = x;
+                sums[label].top = y;
+                sums[label].bottom = y;
+            }
+            else
+            {
+                label = FindRoot(parent, neighbour[0]);
+                for(int i = 1; i < n; i++)
+                {
+                    root = FindRoot(parent, neighbour[i]);
+                    if(root < label)
+                    {
+                        parent[label] = root;
+                        label = root;
+                    }
+                    else if(root > label)
+                    {
+                        parent[root] = label;
+                    }
+                }
+            }
+
+            provisional[k] = label;
+            AddPixel(&sums[label], k, to[k], to[k] - level);
+        }
+    }
+
+    // Roots always have the smallest label of their set, so folding every
+    // label into its root in increasing order leaves complete sums there
+    for(int l = 1; l <= labels; l++)
+    {
+        root = FindRoot(parent, l);
+        parent[l] = root;
+        if(root != l)
+        {
+            MergeSums(&sums[root], &sums[l]);
+        }
+    }
+
+    for(int l = 1; l <= labels; l++)
+    {
+        final[l] = 0;
+        if(parent[l] != l || sums[l].area < minArea)
+        {
+            continue;
+        }
+
+        blob.area = sums[l].area;
+        blob.x = sums[l].x / sums[l].weight;
+        blob.y = sums[l].y / sums[l].weight;
+        blob.peak = sums[l].peak;
+        blob.peakPixel = sums[l].peakPixel;
+        blob.mean = sums[l].sum / sums[l].area;
+        blob.left = sums[l].left;
+        blob.right = sums[l].right;
+        blob.top = sums[l].top;
+        blob.bottom = sums[l].bottom;
+
+        // Insert by area, dropping the smallest once the list is full
+        for(n = blobs->count; n > 0 && blobs->blob[n - 1].area < blob.area; n--)
+        {
+            if(n < MLX90640_MAX_BLOBS)
+            {
+                blobs->blob[n] = blobs->blob[n - 1];
+            }
+        }
+        if(n < MLX90640_MAX_BLOBS)
+        {
+            blobs->blob[n] = blob;
+            if(blobs->count < MLX90640_MAX_BLOBS)
+            {
+                blobs->count++;
+            }
+        }
+    }
+
+    // Map the roots to their place in the sorted list through the peak
+    // pixel, which is unique to each blob
+    for(int i = 0; i < blobs->count; i++)
+    {
+        final[parent[provisional[blobs->blob[i].peakPixel]]] = i + 1;
+    }
+    for(int i = 0; i < 768; i++)
+    {
+        blobs->label[i] = (provisional[i] != 0) ? final[parent[provisional[i]]] : 0;
+    }
+
+    return blobs->count;
+}
+
+//------------------------------------------------------------------------------
+
+static inline uint16_t FindRoot(uint16_t *parent, uint16_t label)
+{
+    while(parent[label] != label)
+    {
+        parent[label] = parent[parent[label]];
+        label = parent[label];
+    }
+
+    return label;
+}
+
+//------------------------------------------------------------------------------
+
+static inline void AddPixel(BlobSums *sums, int pixel, float to, float weight)
+{
+    int x = pixel % 32;
+    int y = pixel / 32;
+
+    sums->area++;
+    sums->sum += to;
+    sums->weight += weight;
+    sums->x += weight * x;
+    sums->y += weight * y;
+    if(to > sums->peak)
+    {
+        sums->peak = to;
+        sums->peakPixel = pixel;
+    }
+    if(x < sums->left)
+    {
+        sums->left = x;
+    }
+    if(x > sums->right)
+    {
+        sums->right = x;
+    }
+    // Rows only grow in scan order, top is set when the label is made
+    if(y > sums->bottom)
+    {
+        sums->bottom = y;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+static void MergeSums(BlobSums *into, const BlobSums *from)
+{
+    into->area += from->area;
+    into->sum += from->sum;
+    into->weight += from->weight;
+    into->x += from->x;
+    into->y += from->y;
+    if(from->peak > into->peak)
+    {
+        into->peak = from->peak;
+        into->peakPixel = from->peakPixel;
+    }
+    if(from->left < into->left)
+    {
+        into->left = from->left;
+    }
+    if(from->right > into->right)
+    {
+        into->right = from->right;
+    }
+    if(from->top < into->top)
+    {
+        into->top = from->top;
+    }
+    if(from->bottom > into->bottom)
+    {
+        into->bottom = from->bottom;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+static float FrameMedian(const float *to)
+{
+    float values[768];
+    float pivot;
+    float t;
+    int n;
+    int lo;
+    int hi;
+    int i;
+    int j;
+    int k;
+
+    n = 0;
+    for(i = 0; i < 768; i++)
+    {
+        if(to[i] == to[i])
+        {
+            values[n++] = to[i];
+        }
+    }
+    if(n == 0)
+    {
+        return 0;
+    }
+
+    // Quickselect of the middle element
+    k = n / 2;
+    lo = 0;
+    hi = n - 1;
+    while(lo < hi)
+    {
+        pivot = values[(lo + hi) / 2];
+        i = lo;
+        j = hi;
+        while(i <= j)
+        {
+            while(values[i] < pivot)
+            {
+                i++;
+            }
+            while(values[j] > pivot)
+            {
+                j--;
+            }
+            if(i <= j)
+            {
+                t = values[i];
+                values[i] = values[j];
+                values[j] = t;
+                i++;
+                j--;
+            }
+        }
+        if(k <= j)
+        {
+            hi = j;
+        }
+        else if(k >= i)
+        {
+            lo = i;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    return values[k];
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_TrackerInit(MLX90640_Tracker *tracker)
+{
+    memset(tracker, 0, sizeof(MLX90640_Tracker));
+    tracker->nextId = 1;
+    tracker->gate = 3.0f;
+    tracker->alpha = 0.5f;
+    tracker->beta = 0.2f;
+    tracker->confirmHits = 3;
+    tracker->maxMisses = 5;
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_TrackerUpdate(MLX90640_Tracker *tracker, const MLX90640_BlobList *blobs, float dt)
+{
+    float distance[MAX_PAIRS];
+    uint8_t pairTrack[MAX_PAIRS];
+    uint8_t pairBlob[MAX_PAIRS];
+    uint8_t blobUsed[MLX90640_MAX_BLOBS];
+    MLX90640_Track *track;
+    const MLX90640_Blob *blob;
+    float dx;
+    float dy;
+    float d;
+    int pairs;
+    int confirmed;
+    int j;
+
+    if(dt <= 0)
+    {
+        dt = 1.0f;
+    }
+
+    // Predict, and list the blobs inside each track's gate
+    pairs = 0;
+    for(int t = 0; t < MLX90640_MAX_TRACKS; t++)
+    {
+        track = &tracker->track[t];
+        if(track->id == 0)
+        {
+            continue;
+        }
+        track->x += track->vx * dt;
+        track->y += track->vy * dt;
+        track->blob = -1;
+
+        for(int b = 0; b < blobs->count; b++)
+        {
+            dx = blobs->blob[b].x - track->x;
+            dy = blobs->blob[b].y - track->y;
+            d = dx * dx + dy * dy;
+            if(d > tracker->gate * tracker->gate)
+            {
+                continue;
+            }
+
+            // Keep the pairs sorted, nearest first
+            for(j = pairs; j > 0 && distance[j - 1] > d; j--)
+            {
+                distance[j] = distance[j - 1];
+                pairTrack[j] = pairTrack[j - 1];
+                pairBlob[j] = pairBlob[j - 1];
+            }
+            distance[j] = d;
+            pairTrack[j] = t;
+            pairBlob[j] = b;
+            pairs++;
+        }
+    }
+
+    // Greedy assignment, each track and blob is used at most once
+    memset(blobUsed, 0, sizeof(blobUsed));
+    for(int i = 0; i < pairs; i++)
+    {
+        track = &tracker->track[pairTrack[i]];
+        if(track->blob >= 0 || blobUsed[pairBlob[i]])
+        {
+            continue;
+        }
+        blob = &blobs->blob[pairBlob[i]];
+        blobUsed[pairBlob[i]] = 1;
+
+        dx = blob->x - track->x;
+        dy = blob->y - track->y;
+        track->x += tracker->alpha * dx;
+        track->y += tracker->alpha * dy;
+        track->vx += tracker->beta * dx / dt;
+        track->vy += tracker->beta * dy / dt;
+        track->blob = pairBlob[i];
+        track->area = blob->area;
+        track->peak = blob->peak;
+        track->mean = blob->mean;
+        track->misses = 0;
+        if(track->hits < 0xFFFF)
+        {
+            track->hits++;
+        }
+        if(track->hits >= tracker->confirmHits)
+        {
+            track->confirmed = 1;
+        }
+    }
+
+    // Deaths
+    for(int t = 0; t < MLX90640_MAX_TRACKS; t++)
+    {
+        track = &tracker->track[t];
+        if(track->id == 0 || track->blob >= 0)
+        {
+            continue;
+        }
+        track->misses++;
+        if(track->confirmed == 0 || track->misses > tracker->maxMisses)
+        {
+            track->id = 0;
+        }
+    }
+
+    // Births, the largest blobs get the free slots first
+    j = 0;
+    for(int b = 0; b < blobs->count; b++)
+    {
+        if(blobUsed[b])
+        {
+            continue;
+        }
+        while(j < MLX90640_MAX_TRACKS && tracker->track[j].id != 0)
+        {
+            j++;
+        }
+        if(j == MLX90640_MAX_TRACKS)
+        {
+            break;
+        }
+        StartTrack(tracker, &tracker->track[j], &blobs->blob[b], b);
+    }
+
+    confirmed = 0;
+    for(int t = 0; t < MLX90640_MAX_TRACKS; t++)
+    {
+        if(tracker->track[t].id != 0 && tracker->track[t].confirmed)
+        {
+            confirmed++;
+        }
+    }
+
+    return confirmed;
+}
+
+//------------------------------------------------------------------------------
+
+static void StartTrack(MLX90640_Tracker *tracker, MLX90640_Track *track, const MLX90640_Blob *blob, int index)
+{
+    memset(track, 0, sizeof(MLX90640_Track));
+    track->id = tracker->nextId;
+    tracker->nextId++;
+    if(tracker->nextId == 0)
+    {
+        tracker->nextId = 1;
+    }
+    track->x = blob->x;
+    track->y = blob->y;
+    track->area = blob->area;
+    track->peak = blob->peak;
+    track->mean = blob->mean;
+    track->blob = index;
+    track->hits = 1;
+    track->confirmed = (tracker->confirmHits <= 1);
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_RoiTablesUpdate(MLX90640_RoiTables *tables, const float *to)
+{
+    const float *lastMin;
+    const float *lastMax;
+    float *runMin;
+    float *runMax;
+    double rowSum;
+    double rowSquares;
+    int half;
+
+    // Row and column 0 of the summed-area tables stay zero
+    memset(tables->sum, 0, 33 * sizeof(double));
+    memset(tables->sumSquares, 0, 33 * sizeof(double));
+    for(int y = 0; y < 24; y++)
+    {
+        tables->sum[33 * (y + 1)] = 0;
+        tables->sumSquares[33 * (y + 1)] = 0;
+        rowSum = 0;
+        rowSquares = 0;
+        for(int x = 0; x < 32; x++)
+        {
+            rowSum += to[32 * y + x];
+            rowSquares += (double)to[32 * y + x] * to[32 * y + x];
+            tables->sum[33 * (y + 1) + x + 1] = tables->sum[33 * y + x + 1] + rowSum;
+            tables->sumSquares[33 * (y + 1) + x + 1] = tables->sumSquares[33 * y + x + 1] + rowSquares;
+        }
+    }
+
+    // Runs of 2^k pixels starting at each column, built from two runs of
+    // 2^(k-1); runs that would pass the end of the row are not used
+    memcpy(tables->runMin[0], to, 768 * sizeof(float));
+    memcpy(tables->runMax[0], to, 768 * sizeof(float));
+    for(int k = 1; k < 6; k++)
+    {
+        half = 1 << (k - 1);
+        for(int y = 0; y < 24; y++)
+        {
+            lastMin = &tables->runMin[k - 1][32 * y];
+            lastMax = &tables->runMax[k - 1][32 * y];
+            runMin = &tables->runMin[k][32 * y];
+            runMax = &tables->runMax[k][32 * y];
+            for(int x = 0; x + 2 * half <= 32; x++)
+            {
+                runMin[x] = fminf(lastMin[x], lastMin[x + half]);
+                runMax[x] = fmaxf(lastMax[x], lastMax[x + half]);
+            }
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_GetRoiStats(const MLX90640_RoiTables *tables, const MLX90640_Roi *rois, int n, MLX90640_RoiStats *stats)
+{
+    // Largest k with 2^k <= width
+    static const uint8_t runLevel[33] = {0, 0, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3,
+                                         4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 5};
+    const MLX90640_Roi *roi;
+    const float *runMin;
+    const float *runMax;
+    double sum;
+    double squares;
+    float low;
+    float high;
+    int a;
+    int b;
+    int c;
+    int d;
+    int area;
+    int level;
+    int second;
+    int answered;
+
+    answered = 0;
+    for(int i = 0; i < n; i++)
+    {
+        roi = &rois[i];
+        if(roi->left > roi->right || roi->right > 31 || roi->top > roi->bottom || roi->bottom > 23)
+        {
+            stats[i].mean = NAN;
+            stats[i].variance = NAN;
+            stats[i].min = NAN;
+            stats[i].max = NAN;
+            continue;
+        }
+
+        // Corners of the rectangle in the padded tables
+        a = 33 * roi->top + roi->left;
+        b = 33 * roi->top + roi->right + 1;
+        c = 33 * (roi->bottom + 1) + roi->left;
+        d = 33 * (roi->bottom + 1) + roi->right + 1;
+        area = (roi->right - roi->left + 1) * (roi->bottom - roi->top + 1);
+
+        sum = tables->sum[d] - tables->sum[b] - tables->sum[c] + tables->sum[a];
+        squares = tables->sumSquares[d] - tables->sumSquares[b] - tables->sumSquares[c] + tables->sumSquares[a];
+        stats[i].mean = sum / area;
+        stats[i].variance = squares / area - (sum / area) * (sum / area);
+        if(stats[i].variance < 0)
+        {
+            stats[i].variance = 0;
+        }
+
+        level = runLevel[roi->right - roi->left + 1];
+        second = roi->right + 1 - (1 << level);
+        runMin = tables->runMin[level];
+        runMax = tables->runMax[level];
+        low = runMin[32 * roi->top + roi->left];
+        high = runMax[32 * roi->top + roi->left];
+        for(int y = roi->top; y <= roi->bottom; y++)
+        {
+            low = fminf(low, fminf(runMin[32 * y + roi->left], runMin[32 * y + second]));
+            high = fmaxf(high, fmaxf(runMax[32 * y + roi->left], runMax[32 * y + second]));
+        }
+        stats[i].min = low;
+        stats[i].max = high;
+        answered++;
+    }
+
+    return answered;
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_ChangeDetectorInit(MLX90640_ChangeDetector *detector, float threshold)
+{
+    memset(detector, 0, sizeof(MLX90640_ChangeDetector));
+    detector->threshold = threshold;
+    detector->alpha = 0.05f;
+    detector->minPixels = 2;
+    detector->refreshInterval = 16;
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_DetectChangeRaw(MLX90640_ChangeDetector *detector, uint16_t *frameData)
+{
+    float raw[768];
+    
+    for(int i = 0; i < 768; i++)
+    {
+        raw[i] = (int16_t)frameData[i];
+    }
+    
+    return CompareBackground(detector, frameData, raw);
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_DetectChange(MLX90640_ChangeDetector *detector, uint16_t *frameData, const float *to)
+{
+    return CompareBackground(detector, frameData, to);
+}
+
+//------------------------------------------------------------------------------
+
+static int CompareBackground(MLX90640_ChangeDetector *detector, uint16_t *frameData, const float *values)
+{
+    static const float oddLanes[4] = {0, 1, 0, 1};
+    float counts[4];
+    simd4f all;
+    simd4f odd;
+    simd4f even;
+    simd4f mask;
+    simd4f one;
+    simd4f limit;
+    simd4f alpha;
+    simd4f background;
+    simd4f delta;
+    simd4f update;
+    simd4f huge;
+    simd4f tile[4];
+    int subPage;
+    int chess;
+    int flags;
+    
+    subPage = frameData[833] & 1;
+    chess = (frameData[832] & 0x1000) != 0;
+    
+    all = simd4f_le(simd4f_set1(0), simd4f_set1(0));
+    odd = simd4f_le(simd4f_set1(0.5f), simd4f_load(oddLanes));
+    even = simd4f_le(simd4f_load(oddLanes), simd4f_set1(0.5f));
+    one = simd4f_set1(1.0f);
+    limit = simd4f_set1(detector->threshold);
+    huge = simd4f_set1(FLT_MAX);
+    // An unprimed subpage takes its readings as they are
+    alpha = simd4f_set1(detector->primed[subPage] ? detector->alpha : 1.0f);
+    
+    flags = 0;
+    for(int ty = 0; ty < 3; ty++)
+    {
+        for(int tx = 0; tx < 4; tx++)
+        {
+            tile[tx] = simd4f_set1(0);
+        }
+        
+        for(int y = 8 * ty; y < 8 * ty + 8; y++)
+        {
+            // Same subpage pattern as the temporal filter
+            if(chess)
+            {
+                mask = (((y & 1) ^ subPage) != 0) ? odd : even;
+            }
+            else if((y & 1) == subPage)
+            {
+                mask = all;
+            }
+            else
+            {
+                continue;
+            }
+            
+            for(int x = 0; x < 32; x += 4)
+            {
+                background = simd4f_load(&detector->background[32 * y + x]);
+                delta = simd4f_sub(simd4f_load(&values[32 * y + x]), background);
+                
+                // A NaN reading counts as changed but is kept out of the
+                // background
+                tile[x / 8] = simd4f_add(tile[x / 8], simd4f_and(mask, simd4f_select(simd4f_le(simd4f_abs(delta), limit), simd4f_set1(0), one)));
+                update = simd4f_and(mask, simd4f_le(simd4f_abs(delta), huge));
+                simd4f_store(&detector->background[32 * y + x], simd4f_select(update, simd4f_add(background, simd4f_mul(alpha, delta)), background));
+            }
+        }
+        
+        for(int tx = 0; tx < 4; tx++)
+        {
+            simd4f_store(counts, tile[tx]);
+            detector->changed[4 * ty + tx] = counts[0] + counts[1] + counts[2] + counts[3];
+            if(detector->changed[4 * ty + tx] >= detector->minPixels)
+            {
+                flags |= 1 << (4 * ty + tx);
+            }
+        }
+    }
+    
+    // The background follows every reading, so a drift too slow to cross
+    // the threshold would otherwise leave the consumer stale for good
+    detector->sinceRefresh[subPage]++;
+    if(detector->primed[subPage] == 0 || (detector->refreshInterval > 0 && detector->sinceRefresh[subPage] >= detector->refreshInterval))
+    {
+        flags = (1 << MLX90640_CHANGE_TILES) - 1;
+        detector->sinceRefresh[subPage] = 0;
+    }
+    detector->primed[subPage] = 1;
+    
+    return flags;
+}
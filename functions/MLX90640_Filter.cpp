@@ -0,0 +1,367 @@
+/**
+ * @copyright (C) 2017 Melexis N.V.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <MLX90640_Filter.h>
+#include "MLX90640_SIMD.h"
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+// The frame is copied into a buffer one pixel wider on every side so the
+// 3x3 window never needs a bounds check
+#define HALO_WIDTH 34
+#define HALO_HEIGHT 26
+
+#define SORT2(a, b) { simd4f t = simd4f_min(a, b); b = simd4f_max(a, b); a = t; }
+
+static void FillHalo(const float *in, float *halo);
+static inline float FreshNeighbourMean(const float *frame, int y, int x, int chess);
+static inline simd4f TemporalStep(MLX90640_TemporalFilter *filter, int pixel, simd4f x, simd4f mask, simd4f gain, simd4f limit);
+
+//------------------------------------------------------------------------------
+
+void MLX90640_MedianFilter(const float *in, float *out)
+{
+    float halo[HALO_WIDTH * HALO_HEIGHT];
+    const float *row;
+    simd4f p[9];
+
+    FillHalo(in, halo);
+
+    for(int y = 0; y < 24; y++)
+    {
+        row = &halo[(y + 1) * HALO_WIDTH + 1];
+        for(int x = 0; x < 32; x += 4)
+        {
+            p[0] = simd4f_load(row + x - HALO_WIDTH - 1);
+            p[1] = simd4f_load(row + x - HALO_WIDTH);
+            p[2] = simd4f_load(row + x - HALO_WIDTH + 1);
+            p[3] = simd4f_load(row + x - 1);
+            p[4] = simd4f_load(row + x);
+            p[5] = simd4f_load(row + x + 1);
+            p[6] = simd4f_load(row + x + HALO_WIDTH - 1);
+            p[7] = simd4f_load(row + x + HALO_WIDTH);
+            p[8] = simd4f_load(row + x + HALO_WIDTH + 1);
+
+            // 19 compare-exchange median-of-9 network
+            SORT2(p[1], p[2]); SORT2(p[4], p[5]); SORT2(p[7], p[8]);
+            SORT2(p[0], p[1]); SORT2(p[3], p[4]); SORT2(p[6], p[7]);
+            SORT2(p[1], p[2]); SORT2(p[4], p[5]); SORT2(p[7], p[8]);
+            SORT2(p[0], p[3]); SORT2(p[5], p[8]); SORT2(p[4], p[7]);
+            SORT2(p[3], p[6]); SORT2(p[1], p[4]); SORT2(p[2], p[5]);
+            SORT2(p[4], p[7]); SORT2(p[4], p[2]); SORT2(p[6], p[4]);
+            SORT2(p[4], p[2]);
+
+            simd4f_store(&out[y * 32 + x], p[4]);
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_SmoothFilter(const float *in, float *out, float threshold)
+{
+    float halo[HALO_WIDTH * HALO_HEIGHT];
+    const float *row;
+    simd4f limit;
+    simd4f one;
+    simd4f centre;
+    simd4f neighbour;
+    simd4f close;
+    simd4f sum;
+    simd4f count;
+
+    FillHalo(in, halo);
+    limit = simd4f_set1(threshold);
+    one = simd4f_set1(1.0f);
+
+    for(int y = 0; y < 24; y++)
+    {
+        row = &halo[(y + 1) * HALO_WIDTH + 1];
+        for(int x = 0; x < 32; x += 4)
+        {
+            centre = simd4f_load(row + x);
+            sum = centre;
+            count = one;
+            for(int dy = -1; dy <= 1; dy++)
+            {
+                for(int dx = -1; dx <= 1; dx++)
+                {
+                    if(dx == 0 && dy == 0)
+                    {
+                        continue;
+                    }
+                    neighbour = simd4f_load(row + x + dy * HALO_WIDTH + dx);
+                    close = simd4f_le(simd4f_abs(simd4f_sub(neighbour, centre)), limit);
+                    sum = simd4f_add(sum, simd4f_and(close, neighbour));
+                    count = simd4f_add(count, simd4f_and(close, one));
+                }
+            }
+
+            simd4f_store(&out[y * 32 + x], simd4f_div(sum, count));
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_Filter(int filter, const float *in, float *out, float threshold)
+{
+    if(filter == MLX90640_FILTER_MEDIAN)
+    {
+        MLX90640_MedianFilter(in, out);
+    }
+    else if(filter == MLX90640_FILTER_SMOOTH)
+    {
+        MLX90640_SmoothFilter(in, out, threshold);
+    }
+    else if(in != out)
+    {
+        for(int i = 0; i < 768; i++)
+        {
+            out[i] = in[i];
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_TemporalFilterInit(MLX90640_TemporalFilter *filter, int mode)
+{
+    memset(filter, 0, sizeof(MLX90640_TemporalFilter));
+    filter->mode = mode;
+    filter->alpha = 0.25f;
+    filter->processNoise = 0.01f;
+    filter->measurementNoise = 0.25f;
+    filter->motionThreshold = 2.0f;
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_TemporalFilterUpdate(MLX90640_TemporalFilter *filter, uint16_t *frameData, const float *to, float *out)
+{
+    static const float oddLanes[4] = {0, 1, 0, 1};
+    simd4f all;
+    simd4f odd;
+    simd4f even;
+    simd4f mask;
+    simd4f gain;
+    simd4f limit;
+    int subPage;
+    int chess;
+    
+    subPage = frameData[833] & 1;
+    chess = (frameData[832] & 0x1000) != 0;
+    
+    if(filter->primed[0] == 0 && filter->primed[1] == 0)
+    {
+        // Start from whatever the caller has for the other subpage
+        for(int i = 0; i < 768; i++)
+        {
+            filter->estimate[i] = to[i];
+            filter->variance[i] = filter->measurementNoise;
+        }
+    }
+    
+    all = simd4f_le(simd4f_set1(0), simd4f_set1(0));
+    odd = simd4f_le(simd4f_set1(0.5f), simd4f_load(oddLanes));
+    even = simd4f_le(simd4f_load(oddLanes), simd4f_set1(0.5f));
+    gain = simd4f_set1(filter->alpha);
+    if(filter->primed[subPage] == 0)
+    {
+        limit = simd4f_set1(0);
+    }
+    else
+    {
+        limit = simd4f_set1((filter->motionThreshold > 0) ? filter->motionThreshold : FLT_MAX);
+    }
+    
+    for(int y = 0; y < 24; y++)
+    {
+        // Interleaved subpages are whole rows, chess subpages alternate
+        // within a row starting on the column parity of the row
+        if(chess)
+        {
+            mask = (((y & 1) ^ subPage) != 0) ? odd : even;
+        }
+        else if((y & 1) == subPage)
+        {
+            mask = all;
+        }
+        else
+        {
+            for(int x = 0; x < 32; x++)
+            {
+                out[32 * y + x] = filter->estimate[32 * y + x];
+            }
+            continue;
+        }
+        
+        for(int x = 0; x < 32; x += 4)
+        {
+            simd4f_store(&out[32 * y + x], TemporalStep(filter, 32 * y + x, simd4f_load(&to[32 * y + x]), mask, gain, limit));
+        }
+    }
+    
+    filter->primed[subPage] = 1;
+}
+
+//------------------------------------------------------------------------------
+
+static inline simd4f TemporalStep(MLX90640_TemporalFilter *filter, int pixel, simd4f x, simd4f mask, simd4f gain, simd4f limit)
+{
+    simd4f estimate;
+    simd4f variance;
+    simd4f delta;
+    simd4f bypass;
+    simd4f noise;
+    
+    estimate = simd4f_load(&filter->estimate[pixel]);
+    variance = simd4f_load(&filter->variance[pixel]);
+    delta = simd4f_sub(x, estimate);
+    noise = simd4f_set1(filter->measurementNoise);
+    
+    if(filter->mode == MLX90640_TEMPORAL_KALMAN)
+    {
+        variance = simd4f_add(variance, simd4f_set1(filter->processNoise));
+        gain = simd4f_div(variance, simd4f_add(variance, noise));
+    }
+    
+    // Start over from the reading when it jumps further than noise could,
+    // or when this subpage has no estimate yet
+    bypass = simd4f_le(limit, simd4f_abs(delta));
+    gain = simd4f_select(bypass, simd4f_set1(1.0f), gain);
+    
+    variance = simd4f_select(bypass, noise, simd4f_sub(variance, simd4f_mul(gain, variance)));
+    estimate = simd4f_select(mask, simd4f_add(estimate, simd4f_mul(gain, delta)), estimate);
+    variance = simd4f_select(mask, variance, simd4f_load(&filter->variance[pixel]));
+    
+    simd4f_store(&filter->estimate[pixel], estimate);
+    simd4f_store(&filter->variance[pixel], variance);
+    
+    return estimate;
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_DeinterlacerInit(MLX90640_Deinterlacer *deinterlacer)
+{
+    memset(deinterlacer, 0, sizeof(MLX90640_Deinterlacer));
+    deinterlacer->motionThreshold = 1.0f;
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_Deinterlace(MLX90640_Deinterlacer *deinterlacer, uint16_t *frameData, const float *to, float *out)
+{
+    int subPage;
+    int chess;
+    int pattern;
+    float spatial;
+    float motion;
+    float weight;
+    
+    subPage = frameData[833] & 1;
+    chess = (frameData[832] & 0x1000) != 0;
+    
+    for(int y = 0; y < 24; y++)
+    {
+        for(int x = 0; x < 32; x++)
+        {
+            pattern = chess ? ((y ^ x) & 1) : (y & 1);
+            if(pattern == subPage)
+            {
+                out[32 * y + x] = to[32 * y + x];
+                continue;
+            }
+            
+            // The stale pixel is kept where its fresh neighbours have not
+            // moved since their last reading and interpolated from them
+            // where they have
+            spatial = FreshNeighbourMean(to, y, x, chess);
+            weight = 1.0f;
+            if(deinterlacer->primed && deinterlacer->motionThreshold > 0)
+            {
+                motion = fabsf(spatial - FreshNeighbourMean(deinterlacer->previous, y, x, chess));
+                weight = motion / deinterlacer->motionThreshold;
+                if(weight > 1.0f)
+                {
+                    weight = 1.0f;
+                }
+            }
+            out[32 * y + x] = to[32 * y + x] + weight * (spatial - to[32 * y + x]);
+        }
+    }
+    
+    memcpy(deinterlacer->previous, to, sizeof(deinterlacer->previous));
+    deinterlacer->primed = 1;
+}
+
+//------------------------------------------------------------------------------
+
+static inline float FreshNeighbourMean(const float *frame, int y, int x, int chess)
+{
+    float sum = 0;
+    int n = 0;
+    
+    // Rows above and below always belong to the other subpage, in chess
+    // mode the pixels left and right do too
+    if(y > 0)
+    {
+        sum += frame[32 * (y - 1) + x];
+        n = n + 1;
+    }
+    if(y < 23)
+    {
+        sum += frame[32 * (y + 1) + x];
+        n = n + 1;
+    }
+    if(chess && x > 0)
+    {
+        sum += frame[32 * y + x - 1];
+        n = n + 1;
+    }
+    if(chess && x < 31)
+    {
+        sum += frame[32 * y + x + 1];
+        n = n + 1;
+    }
+    
+    return sum / n;
+}
+
+//------------------------------------------------------------------------------
+
+static void FillHalo(const float *in, float *halo)
+{
+    float *row;
+    const float *src;
+
+    for(int y = 0; y < HALO_HEIGHT; y++)
+    {
+        src = &in[32 * ((y == 0) ? 0 : (y == HALO_HEIGHT - 1) ? 23 : y - 1)];
+        row = &halo[y * HALO_WIDTH];
+        row[0] = src[0];
+        for(int x = 0; x < 32; x++)
+        {
+            row[x + 1] = src[x];
+        }
+        for(int x = 33; x < HALO_WIDTH; x++)
+        {
+            row[x] = src[31];
+        }
+    }
+}
@@ -0,0 +1,706 @@
+/**
+ * @copyright (C) 2017 Melexis N.V.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+ /**
+ * Runtime selection of the I2C transport. Every backend compiled into the
+ * library is registered here and can be picked per slave address, so the
+ * same binary can talk to one sensor through i2c-dev and to another (or the
+ * same one, for comparison) through bcm2835.
+ *
+ * The default backend is chosen with, in order of precedence, the
+ * MLX90640_I2C_BACKEND environment variable, MLX90640_I2CSetDefaultBackend()
+ * and the MLX90640_I2C_DEFAULT build flag.
+ *
+ * Each device may also carry its own bus clock and a faster clock used only
+ * for the burst RAM read; both are re-applied lazily when the backend is
+ * shared by devices with different settings.
+ *
+ * When profiling is enabled every transaction is timed here, so the numbers
+ * include the kernel/library driver but none of the conversion work.
+ * Transactions are split by purpose, derived from the register address.
+ */
+#include "MLX90640_I2C_Driver.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <chrono>
+
+static const MLX90640_I2CBackend *backends[MLX90640_I2C_MAX_BACKENDS];
+static uint8_t backendReady[MLX90640_I2C_MAX_BACKENDS];
+static int backendCount = 0;
+static int builtinsRegistered = 0;
+static const MLX90640_I2CBackend *defaultBackend = 0;
+static const MLX90640_I2CBackend *deviceBackend[128];
+static int backendFreq[MLX90640_I2C_MAX_BACKENDS];
+static int deviceFreq[128];
+static int deviceBurstFreq[128];
+static int profileEnabled = 0;
+static MLX90640_I2CProfile profile;
+
+static void RegisterBuiltinBackends(void);
+static int BackendIndex(const MLX90640_I2CBackend *backend);
+static const MLX90640_I2CBackend *PrepareBackend(uint8_t slaveAddr);
+static int ApplyFreq(const MLX90640_I2CBackend *backend, int freq);
+static int ReadWords(const MLX90640_I2CBackend *backend, uint8_t slaveAddr, uint16_t startAddress, uint16_t nWords, uint16_t *data);
+static int ReadBytes(const MLX90640_I2CBackend *backend, uint8_t slaveAddr, uint16_t startAddress, uint16_t nWords, uint8_t *buf);
+static int ReadBurst(uint8_t slaveAddr, uint16_t startAddress, uint16_t nWords, uint16_t *data, uint8_t *buf);
+static void ProfileRecord(uint16_t address, uint32_t bytes, int error, std::chrono::steady_clock::time_point start);
+
+//------------------------------------------------------------------------------
+
+int MLX90640_I2CRegisterBackend(const MLX90640_I2CBackend *backend)
+{
+    if(backend == 0 || backend->name == 0 || backend->read == 0 || backend->write == 0)
+    {
+        return -1;
+    }
+
+    if(BackendIndex(backend) >= 0)
+    {
+        return 0;
+    }
+
+    if(backendCount >= MLX90640_I2C_MAX_BACKENDS)
+    {
+        return -1;
+    }
+
+    backends[backendCount] = backend;
+    backendReady[backendCount] = 0;
+    backendFreq[backendCount] = 0;
+    backendCount = backendCount + 1;
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+
+const MLX90640_I2CBackend *MLX90640_I2CFindBackend(const char *name)
+{
+    RegisterBuiltinBackends();
+
+    if(name == 0)
+    {
+        return 0;
+    }
+
+    for(int i = 0; i < backendCount; i++)
+    {
+        if(strcasecmp(backends[i]->name, name) == 0)
+        {
+            return backends[i];
+        }
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_I2CGetBackendCount(void)
+{
+    RegisterBuiltinBackends();
+    return backendCount;
+}
+
+//------------------------------------------------------------------------------
+
+const MLX90640_I2CBackend *MLX90640_I2CGetBackendByIndex(int index)
+{
+    RegisterBuiltinBackends();
+
+    if(index < 0 || index >= backendCount)
+    {
+        return 0;
+    }
+
+    return backends[index];
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_I2CSetDefaultBackend(const char *name)
+{
+    const MLX90640_I2CBackend *backend;
+
+    backend = MLX90640_I2CFindBackend(name);
+    if(backend == 0)
+    {
+        return -1;
+    }
+
+    defaultBackend = backend;
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_I2CSetBackend(uint8_t slaveAddr, const char *name)
+{
+    const MLX90640_I2CBackend *backend = 0;
+
+    if(slaveAddr > 127)
+    {
+        return -1;
+    }
+
+    if(name != 0)
+    {
+        backend = MLX90640_I2CFindBackend(name);
+        if(backend == 0)
+        {
+            return -1;
+        }
+    }
+
+    deviceBackend[slaveAddr] = backend;
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+
+const MLX90640_I2CBackend *MLX90640_I2CGetBackend(uint8_t slaveAddr)
+{
+    RegisterBuiltinBackends();
+
+    if(slaveAddr < 128 && deviceBackend[slaveAddr] != 0)
+    {
+        return deviceBackend[slaveAddr];
+    }
+
+    return defaultBackend;
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_I2CInit(void)
+{
+    const MLX90640_I2CBackend *backend;
+    int index;
+
+    RegisterBuiltinBackends();
+
+    backend = defaultBackend;
+    index = BackendIndex(backend);
+    if(index >= 0 && backendReady[index] == 0)
+    {
+        if(backend->init == 0 || backend->init() == 0)
+        {
+            backendReady[index] = 1;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_I2CRead(uint8_t slaveAddr, uint16_t startAddress, uint16_t nMemAddressRead, uint16_t *data)
+{
+    const MLX90640_I2CBackend *backend;
+
+    backend = PrepareBackend(slaveAddr);
+    if(backend == 0)
+    {
+        return -1;
+    }
+
+    return ReadWords(backend, slaveAddr, startAddress, nMemAddressRead, data);
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_I2CReadBurst(uint8_t slaveAddr, uint16_t startAddress, uint16_t nMemAddressRead, uint16_t *data)
+{
+    return ReadBurst(slaveAddr, startAddress, nMemAddressRead, data, 0);
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_I2CReadBurstBytes(uint8_t slaveAddr, uint16_t startAddress, uint16_t nMemAddressRead, uint8_t *buf)
+{
+    return ReadBurst(slaveAddr, startAddress, nMemAddressRead, 0, buf);
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_I2CWrite(uint8_t slaveAddr, uint16_t writeAddress, uint16_t data)
+{
+    const MLX90640_I2CBackend *backend;
+
+    std::chrono::steady_clock::time_point start;
+    int error;
+
+    backend = PrepareBackend(slaveAddr);
+    if(backend == 0)
+    {
+        return -1;
+    }
+
+    if(!profileEnabled)
+    {
+        return backend->write(slaveAddr, writeAddress, data);
+    }
+
+    start = std::chrono::steady_clock::now();
+    error = backend->write(slaveAddr, writeAddress, data);
+    ProfileRecord(writeAddress, 4, error, start);
+
+    return error;
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_I2CTransfer(uint8_t slaveAddr, MLX90640_I2CMessage *msgs, int nMsgs)
+{
+    const MLX90640_I2CBackend *backend;
+    int error = 0;
+
+    if(nMsgs < 1 || nMsgs > MLX90640_I2C_MAX_MESSAGES)
+    {
+        return -1;
+    }
+
+    backend = PrepareBackend(slaveAddr);
+    if(backend == 0)
+    {
+        return -1;
+    }
+
+    if(backend->transfer != 0)
+    {
+        std::chrono::steady_clock::time_point start;
+        uint32_t bytes = 0;
+        int largest = 0;
+
+        if(!profileEnabled)
+        {
+            return backend->transfer(slaveAddr, msgs, nMsgs);
+        }
+
+        // The whole transaction is booked against its largest message
+        for(int i = 0; i < nMsgs; i++)
+        {
+            bytes += (msgs[i].flags == MLX90640_I2C_MSG_WRITE) ? 4 : 2 + 2 * msgs[i].nWords;
+            if(msgs[i].nWords > msgs[largest].nWords)
+            {
+                largest = i;
+            }
+        }
+
+        start = std::chrono::steady_clock::now();
+        error = backend->transfer(slaveAddr, msgs, nMsgs);
+        ProfileRecord(msgs[largest].address, bytes, error, start);
+
+        return error;
+    }
+
+    for(int i = 0; i < nMsgs && error == 0; i++)
+    {
+        if(msgs[i].flags == MLX90640_I2C_MSG_WRITE)
+        {
+            error = MLX90640_I2CWrite(slaveAddr, msgs[i].address, msgs[i].data[0]);
+        }
+        else
+        {
+            error = ReadWords(backend, slaveAddr, msgs[i].address, msgs[i].nWords, msgs[i].data);
+        }
+    }
+
+    return error;
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_I2CFreqSet(int freq)
+{
+    RegisterBuiltinBackends();
+
+    if(defaultBackend != 0)
+    {
+        ApplyFreq(defaultBackend, freq);
+    }
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_I2CSetFreq(uint8_t slaveAddr, int freq)
+{
+    const MLX90640_I2CBackend *backend;
+
+    if(slaveAddr > 127 || freq < 0)
+    {
+        return -1;
+    }
+
+    backend = PrepareBackend(slaveAddr);
+    if(backend == 0)
+    {
+        return -1;
+    }
+
+    if(freq > 0 && backend->freqSet == 0)
+    {
+        return -1;
+    }
+
+    deviceFreq[slaveAddr] = freq;
+    if(freq == 0)
+    {
+        // Without a base clock to go back to, a burst clock would stay on
+        deviceBurstFreq[slaveAddr] = 0;
+    }
+
+    return ApplyFreq(backend, freq);
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_I2CSetBurstFreq(uint8_t slaveAddr, int freq)
+{
+    const MLX90640_I2CBackend *backend;
+
+    if(slaveAddr > 127 || freq < 0)
+    {
+        return -1;
+    }
+
+    backend = MLX90640_I2CGetBackend(slaveAddr);
+    if(backend == 0 || (freq > 0 && backend->freqSet == 0))
+    {
+        return -1;
+    }
+
+    // Bursts switch back to the base clock afterwards, so one must be set
+    if(freq > 0 && deviceFreq[slaveAddr] == 0)
+    {
+        return -1;
+    }
+
+    deviceBurstFreq[slaveAddr] = freq;
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_I2CGetFreq(uint8_t slaveAddr)
+{
+    if(slaveAddr > 127)
+    {
+        return -1;
+    }
+
+    return deviceFreq[slaveAddr];
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_I2CProfileEnable(int enable)
+{
+    profileEnabled = enable;
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_I2CProfileReset(void)
+{
+    memset(&profile, 0, sizeof(profile));
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_I2CProfileSnapshot(MLX90640_I2CProfile *snapshot)
+{
+    memcpy(snapshot, &profile, sizeof(profile));
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_I2CProfileRetry(uint16_t address)
+{
+    if(profileEnabled)
+    {
+        profile.purpose[MLX90640_I2CGetPurpose(address)].retries++;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_I2CGetPurpose(uint16_t address)
+{
+    if(address == 0x8000)
+    {
+        return MLX90640_I2C_PURPOSE_STATUS;
+    }
+    if(address >= 0x0400 && address < 0x0740)
+    {
+        return MLX90640_I2C_PURPOSE_RAM;
+    }
+    if(address > 0x8000 && address < 0x8020)
+    {
+        return MLX90640_I2C_PURPOSE_CONTROL;
+    }
+    if(address >= 0x2400 && address < 0x2740)
+    {
+        return MLX90640_I2C_PURPOSE_EEPROM;
+    }
+
+    return MLX90640_I2C_PURPOSE_OTHER;
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_I2CUnpack(const uint8_t *buf, uint16_t nWords, uint16_t *data)
+{
+    for(int count = 0; count < nWords; count++)
+    {
+        int i = count << 1;
+        data[count] = ((uint16_t)buf[i] << 8) | buf[i+1];
+    }
+}
+
+//------------------------------------------------------------------------------
+
+static void RegisterBuiltinBackends(void)
+{
+    const char *name;
+
+    if(builtinsRegistered)
+    {
+        return;
+    }
+    builtinsRegistered = 1;
+
+#ifdef MLX90640_I2C_LINUX
+    MLX90640_I2CRegisterBackend(&MLX90640_LinuxI2CBackend);
+#endif
+#ifdef MLX90640_I2C_RPI
+    MLX90640_I2CRegisterBackend(&MLX90640_RPII2CBackend);
+#endif
+#ifdef MLX90640_I2C_MBED
+    MLX90640_I2CRegisterBackend(&MLX90640_MbedI2CBackend);
+#endif
+#ifdef MLX90640_I2C_SWI2C
+    MLX90640_I2CRegisterBackend(&MLX90640_SWI2CBackend);
+#endif
+
+    if(backendCount > 0)
+    {
+        defaultBackend = backends[0];
+    }
+
+#ifdef MLX90640_I2C_DEFAULT
+    MLX90640_I2CSetDefaultBackend(MLX90640_I2C_DEFAULT);
+#endif
+
+    name = getenv("MLX90640_I2C_BACKEND");
+    if(name != 0 && MLX90640_I2CSetDefaultBackend(name) != 0)
+    {
+        fprintf(stderr, "Unknown I2C backend: %s\n", name);
+    }
+}
+
+//------------------------------------------------------------------------------
+
+static int BackendIndex(const MLX90640_I2CBackend *backend)
+{
+    for(int i = 0; i < backendCount; i++)
+    {
+        if(backends[i] == backend)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+//------------------------------------------------------------------------------
+
+static const MLX90640_I2CBackend *PrepareBackend(uint8_t slaveAddr)
+{
+    const MLX90640_I2CBackend *backend;
+    int index;
+
+    backend = MLX90640_I2CGetBackend(slaveAddr);
+    index = BackendIndex(backend);
+    if(index < 0)
+    {
+        return 0;
+    }
+
+    if(backendReady[index] == 0)
+    {
+        if(backend->init != 0 && backend->init() != 0)
+        {
+            return 0;
+        }
+        backendReady[index] = 1;
+    }
+
+    ApplyFreq(backend, deviceFreq[slaveAddr & 0x7F]);
+
+    return backend;
+}
+
+//------------------------------------------------------------------------------
+
+static int ApplyFreq(const MLX90640_I2CBackend *backend, int freq)
+{
+    int index;
+    int error;
+
+    index = BackendIndex(backend);
+    if(index < 0)
+    {
+        return -1;
+    }
+
+    if(freq <= 0 || backendFreq[index] == freq)
+    {
+        return 0;
+    }
+
+    if(backend->freqSet == 0)
+    {
+        return -1;
+    }
+
+    error = backend->freqSet(freq);
+    if(error == 0)
+    {
+        backendFreq[index] = freq;
+    }
+
+    return error;
+}
+
+//------------------------------------------------------------------------------
+
+static int ReadWords(const MLX90640_I2CBackend *backend, uint8_t slaveAddr, uint16_t startAddress, uint16_t nWords, uint16_t *data)
+{
+    uint8_t buf[1664];
+    int error;
+
+    error = ReadBytes(backend, slaveAddr, startAddress, nWords, buf);
+    if(error != 0)
+    {
+        return error;
+    }
+
+    MLX90640_I2CUnpack(buf, nWords, data);
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+
+static int ReadBytes(const MLX90640_I2CBackend *backend, uint8_t slaveAddr, uint16_t startAddress, uint16_t nWords, uint8_t *buf)
+{
+    std::chrono::steady_clock::time_point start;
+    int error;
+
+    if(nWords > 832)
+    {
+        return -1;
+    }
+
+    if(profileEnabled)
+    {
+        start = std::chrono::steady_clock::now();
+        error = backend->read(slaveAddr, startAddress, nWords, buf);
+        ProfileRecord(startAddress, 2 + 2 * nWords, error, start);
+    }
+    else
+    {
+        error = backend->read(slaveAddr, startAddress, nWords, buf);
+    }
+
+    return error;
+}
+
+//------------------------------------------------------------------------------
+
+static int ReadBurst(uint8_t slaveAddr, uint16_t startAddress, uint16_t nWords, uint16_t *data, uint8_t *buf)
+{
+    const MLX90640_I2CBackend *backend;
+    int burstFreq;
+    int error;
+
+    backend = PrepareBackend(slaveAddr);
+    if(backend == 0)
+    {
+        return -1;
+    }
+
+    burstFreq = deviceBurstFreq[slaveAddr & 0x7F];
+    if(burstFreq > 0)
+    {
+        ApplyFreq(backend, burstFreq);
+    }
+
+    if(data != 0)
+    {
+        error = ReadWords(backend, slaveAddr, startAddress, nWords, data);
+    }
+    else
+    {
+        error = ReadBytes(backend, slaveAddr, startAddress, nWords, buf);
+    }
+
+    if(burstFreq > 0)
+    {
+        ApplyFreq(backend, deviceFreq[slaveAddr & 0x7F]);
+    }
+
+    return error;
+}
+
+//------------------------------------------------------------------------------
+
+static void ProfileRecord(uint16_t address, uint32_t bytes, int error, std::chrono::steady_clock::time_point start)
+{
+    MLX90640_I2CProfileStats *stats;
+    uint32_t elapsed;
+    int bucket = 0;
+
+    elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    stats = &profile.purpose[MLX90640_I2CGetPurpose(address)];
+    if(stats->calls == 0 || elapsed < stats->minTime)
+    {
+        stats->minTime = elapsed;
+    }
+    if(elapsed > stats->maxTime)
+    {
+        stats->maxTime = elapsed;
+    }
+    stats->calls++;
+    stats->bytes += bytes;
+    stats->totalTime += elapsed;
+    if(error != 0)
+    {
+        stats->errors++;
+    }
+
+    while((elapsed >> (bucket + 1)) != 0 && bucket < MLX90640_I2C_PROFILE_BUCKETS - 1)
+    {
+        bucket++;
+    }
+    stats->histogram[bucket]++;
+}
@@ -19,22 +19,33 @@
 
 I2C i2c(p9, p10);
 
-void MLX90640_I2CInit()
+static int MbedI2CInit(void);
+static int MbedI2CRead(uint8_t slaveAddr, uint16_t startAddress, uint16_t nMemAddressRead, uint8_t *buf);
+static int MbedI2CWrite(uint8_t slaveAddr, uint16_t writeAddress, uint16_t data);
+static int MbedI2CFreqSet(int freq);
+
+const MLX90640_I2CBackend MLX90640_MbedI2CBackend =
+{
+    "mbed",
+    MbedI2CInit,
+    MbedI2CRead,
+    MbedI2CWrite,
+    0,
+    MbedI2CFreqSet
+};
+
+static int MbedI2CInit(void)
 {   
     i2c.stop();
+    return 0;
 }
 
-int MLX90640_I2CRead(uint8_t slaveAddr, uint16_t startAddress, uint16_t nMemAddressRead, uint16_t *data)
+static int MbedI2CRead(uint8_t slaveAddr, uint16_t startAddress, uint16_t nMemAddressRead, uint8_t *buf)
 {
     uint8_t sa;                           
     int ack = 0;                               
-    int cnt = 0;
-    int i = 0;
     char cmd[2] = {0,0};
-    char i2cData[1664] = {0};
-    uint16_t *p;
     
-    p = data;
     sa = (slaveAddr << 1);
     cmd[0] = startAddress >> 8;
     cmd[1] = startAddress & 0x00FF;
@@ -49,7 +60,7 @@ int MLX90640_I2CRead(uint8_t slaveAddr, uint16_t startAddress, uint16_t nMemAddr
     }
              
     sa = sa | 0x01;
-    ack = i2c.read(sa, i2cData, 2*nMemAddressRead, 0);
+    ack = i2c.read(sa, (char*)buf, 2*nMemAddressRead, 0);
     
     if (ack != 0x00)
     {
@@ -57,21 +68,16 @@ int MLX90640_I2CRead(uint8_t slaveAddr, uint16_t startAddress, uint16_t nMemAddr
     }          
     i2c.stop();   
     
-    for(cnt=0; cnt < nMemAddressRead; cnt++)
-    {
-        i = cnt << 1;
-        *p++ = (uint16_t)i2cData[i]*256 + (uint16_t)i2cData[i+1];
-    }
-    
     return 0;   
 } 
 
-void MLX90640_I2CFreqSet(int freq)
+static int MbedI2CFreqSet(int freq)
 {
     i2c.frequency(1000*freq);
+    return 0;
 }
 
-int MLX90640_I2CWrite(uint8_t slaveAddr, uint16_t writeAddress, uint16_t data)
+static int MbedI2CWrite(uint8_t slaveAddr, uint16_t writeAddress, uint16_t data)
 {
     uint8_t sa;
     int ack = 0;
@@ -18,6 +18,7 @@
 #include <iostream>
 #include <unistd.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <fcntl.h>
 #include <string.h>
 #include <linux/i2c-dev.h>
@@ -30,24 +31,52 @@
 
 #include <sys/ioctl.h>
 
-int i2c_fd = 0;
-const char *i2c_device = "/dev/i2c-1";
+static int i2c_fd = -1;
+static const char *i2c_device = "/dev/i2c-1";
 
-void MLX90640_I2CInit()
-{
-    
-}
+static int LinuxI2CInit(void);
+static int LinuxI2CRead(uint8_t slaveAddr, uint16_t startAddress, uint16_t nWords, uint8_t *buf);
+static int LinuxI2CWrite(uint8_t slaveAddr, uint16_t writeAddress, uint16_t data);
+static int LinuxI2CTransfer(uint8_t slaveAddr, MLX90640_I2CMessage *msgs, int nMsgs);
 
-int MLX90640_I2CRead(uint8_t slaveAddr, uint16_t startAddress, uint16_t nMemAddressRead, uint16_t *data)
+const MLX90640_I2CBackend MLX90640_LinuxI2CBackend =
+{
+    "linux",
+    LinuxI2CInit,
+    LinuxI2CRead,
+    LinuxI2CWrite,
+    LinuxI2CTransfer,
+    0
+};
+
+static int LinuxI2CInit(void)
 {
-    if(!i2c_fd){
-        i2c_fd = open(i2c_device, O_RDWR);
+    const char *device;
+
+    if(i2c_fd >= 0)
+    {
+        return 0;
+    }
+
+    device = getenv("MLX90640_I2C_DEVICE");
+    if(device == 0)
+    {
+        device = i2c_device;
+    }
+
+    i2c_fd = open(device, O_RDWR);
+    if(i2c_fd < 0)
+    {
+        printf("I2C Open Error: %s\n", device);
+        return -1;
     }
 
-    int result;
+    return 0;
+}
+
+static int LinuxI2CRead(uint8_t slaveAddr, uint16_t startAddress, uint16_t nWords, uint8_t *buf)
+{
     char cmd[2] = {(char)(startAddress >> 8), (char)(startAddress & 0xFF)};
-    char buf[1664];
-    uint16_t *p = data;
     struct i2c_msg i2c_messages[2];
     struct i2c_rdwr_ioctl_data i2c_messageset[1];
 
@@ -58,37 +87,25 @@ int MLX90640_I2CRead(uint8_t slaveAddr, uint16_t startAddress, uint16_t nMemAddr
 
     i2c_messages[1].addr = slaveAddr;
     i2c_messages[1].flags = I2C_M_RD | I2C_M_NOSTART;
-    i2c_messages[1].len = nMemAddressRead * 2;
+    i2c_messages[1].len = nWords * 2;
     i2c_messages[1].buf = (I2C_MSG_FMT*)buf;
 
-    //result = write(i2c_fd, cmd, 3);    
-    //result = read(i2c_fd, buf, nMemAddressRead*2);
     i2c_messageset[0].msgs = i2c_messages;
     i2c_messageset[0].nmsgs = 2;
 
-    memset(buf, 0, nMemAddressRead * 2);
+    memset(buf, 0, nWords * 2);
 
     if (ioctl(i2c_fd, I2C_RDWR, &i2c_messageset) < 0) {
         printf("I2C Read Error!\n");
         return -1;
     }
 
-    for(int count = 0; count < nMemAddressRead; count++){
-	int i = count << 1;
-    	*p++ = ((uint16_t)buf[i] << 8) | buf[i+1];
-    }
-
     return 0;
 } 
 
-void MLX90640_I2CFreqSet(int freq)
-{
-}
-
-int MLX90640_I2CWrite(uint8_t slaveAddr, uint16_t writeAddress, uint16_t data)
+static int LinuxI2CWrite(uint8_t slaveAddr, uint16_t writeAddress, uint16_t data)
 { 
     char cmd[4] = {(char)(writeAddress >> 8), (char)(writeAddress & 0x00FF), (char)(data >> 8), (char)(data & 0x00FF)};
-    int result;
 
     struct i2c_msg i2c_messages[1];
     struct i2c_rdwr_ioctl_data i2c_messageset[1];
@@ -108,3 +125,70 @@ int MLX90640_I2CWrite(uint8_t slaveAddr, uint16_t writeAddress, uint16_t data)
 
     return 0;
 }
+
+// Packs every message into a single I2C_RDWR ioctl so the whole sequence
+// costs one syscall and is not interleaved with other bus users.
+static int LinuxI2CTransfer(uint8_t slaveAddr, MLX90640_I2CMessage *msgs, int nMsgs)
+{
+    char cmd[MLX90640_I2C_MAX_MESSAGES][4];
+    uint8_t buf[2 * (832 + MLX90640_I2C_MAX_MESSAGES)];
+    struct i2c_msg i2c_messages[2 * MLX90640_I2C_MAX_MESSAGES];
+    struct i2c_rdwr_ioctl_data i2c_messageset[1];
+    int nI2CMsgs = 0;
+    int offset = 0;
+
+    for(int i = 0; i < nMsgs; i++)
+    {
+        cmd[i][0] = (char)(msgs[i].address >> 8);
+        cmd[i][1] = (char)(msgs[i].address & 0x00FF);
+
+        i2c_messages[nI2CMsgs].addr = slaveAddr;
+        i2c_messages[nI2CMsgs].flags = 0;
+        i2c_messages[nI2CMsgs].buf = (I2C_MSG_FMT*)cmd[i];
+
+        if(msgs[i].flags == MLX90640_I2C_MSG_WRITE)
+        {
+            cmd[i][2] = (char)(msgs[i].data[0] >> 8);
+            cmd[i][3] = (char)(msgs[i].data[0] & 0x00FF);
+            i2c_messages[nI2CMsgs].len = 4;
+            nI2CMsgs++;
+            continue;
+        }
+
+        if(offset + 2 * msgs[i].nWords > (int)sizeof(buf))
+        {
+            return -1;
+        }
+
+        i2c_messages[nI2CMsgs].len = 2;
+        nI2CMsgs++;
+
+        i2c_messages[nI2CMsgs].addr = slaveAddr;
+        i2c_messages[nI2CMsgs].flags = I2C_M_RD | I2C_M_NOSTART;
+        i2c_messages[nI2CMsgs].len = msgs[i].nWords * 2;
+        i2c_messages[nI2CMsgs].buf = (I2C_MSG_FMT*)(buf + offset);
+        nI2CMsgs++;
+
+        offset += 2 * msgs[i].nWords;
+    }
+
+    i2c_messageset[0].msgs = i2c_messages;
+    i2c_messageset[0].nmsgs = nI2CMsgs;
+
+    if (ioctl(i2c_fd, I2C_RDWR, &i2c_messageset) < 0) {
+        printf("I2C Transfer Error!\n");
+        return -1;
+    }
+
+    offset = 0;
+    for(int i = 0; i < nMsgs; i++)
+    {
+        if(msgs[i].flags != MLX90640_I2C_MSG_WRITE)
+        {
+            MLX90640_I2CUnpack(buf + offset, msgs[i].nWords, msgs[i].data);
+            offset += 2 * msgs[i].nWords;
+        }
+    }
+
+    return 0;
+}
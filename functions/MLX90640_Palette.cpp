@@ -0,0 +1,235 @@
+/**
+ * @copyright (C) 2017 Melexis N.V.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <MLX90640_Palette.h>
+#include <MLX90640_API.h>
+#include "MLX90640_SIMD.h"
+#include <string.h>
+
+// Temperatures are quantised and written in runs of this many pixels
+#define INDEX_RUN 64
+
+typedef struct
+    {
+        int count;
+        float rgb[8][3];
+    } KeyColours;
+
+static const KeyColours palettes[4] = {
+    // Heatmap, from http://www.andrewnoske.com/wiki/Code_-_heatmaps_and_color_gradients
+    {7, {{0, 0, 0}, {0, 0, 1}, {0, 1, 0}, {1, 1, 0}, {1, 0, 0}, {1, 0, 1}, {1, 1, 1}}},
+    // Iron
+    {7, {{0, 0, 0}, {0.2f, 0, 0.5f}, {0.6f, 0, 0.6f}, {0.9f, 0.2f, 0.1f}, {1, 0.55f, 0}, {1, 0.9f, 0.2f}, {1, 1, 1}}},
+    // Rainbow
+    {5, {{0, 0, 1}, {0, 1, 1}, {0, 1, 0}, {1, 1, 0}, {1, 0, 0}}},
+    // Grey
+    {2, {{0, 0, 0}, {1, 1, 1}}}
+};
+
+static void EncodeColour(int r, int g, int b, int format, uint8_t *colour);
+
+//------------------------------------------------------------------------------
+
+int MLX90640_PaletteInit(MLX90640_Palette *palette, int colours, int size, int format, float minTemp, float maxTemp)
+{
+    static const uint8_t bytesPerPixel[5] = {2, 3, 4, 4, 3};
+    const KeyColours *keys;
+    float v;
+    float fraction;
+    int idx;
+    int c[3];
+
+    if(colours < MLX90640_PALETTE_HEATMAP || colours > MLX90640_PALETTE_GREY)
+    {
+        return -1;
+    }
+    if(format < MLX90640_FORMAT_RGB565 || format > MLX90640_FORMAT_BGR24)
+    {
+        return -1;
+    }
+    if(size < 2 || size > MLX90640_PALETTE_MAX_SIZE)
+    {
+        return -1;
+    }
+
+    memset(palette, 0, sizeof(MLX90640_Palette));
+    palette->size = size;
+    palette->format = format;
+    palette->bytesPerPixel = bytesPerPixel[format];
+
+    keys = &palettes[colours];
+    for(int i = 0; i < size; i++)
+    {
+        v = i * (keys->count - 1.0f) / (size - 1);
+        idx = (int)v;
+        if(idx > keys->count - 2)
+        {
+            idx = keys->count - 2;
+        }
+        fraction = v - idx;
+        for(int k = 0; k < 3; k++)
+        {
+            c[k] = (int)(((keys->rgb[idx + 1][k] - keys->rgb[idx][k]) * fraction + keys->rgb[idx][k]) * 255.0f);
+        }
+        EncodeColour(c[0], c[1], c[2], format, palette->colour[i]);
+    }
+
+    if(MLX90640_PaletteSetRange(palette, minTemp, maxTemp) != 0)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_PaletteSetRange(MLX90640_Palette *palette, float minTemp, float maxTemp)
+{
+    if(!(maxTemp > minTemp))
+    {
+        return -1;
+    }
+
+    // index = (to - minTemp) * scale + 0.5, folded so the truncation
+    // rounds to the nearest entry
+    palette->minTemp = minTemp;
+    palette->maxTemp = maxTemp;
+    palette->scale = (palette->size - 1) / (maxTemp - minTemp);
+    palette->offset = 0.5f - minTemp * palette->scale;
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_PaletteSetRadianceRange(MLX90640_Palette *palette, float minTemp, float maxTemp)
+{
+    return MLX90640_PaletteSetRange(palette, MLX90640_TemperatureToRadiance(minTemp), MLX90640_TemperatureToRadiance(maxTemp));
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_PaletteIndex(const MLX90640_Palette *palette, const float *to, uint16_t *index, int n)
+{
+    int32_t lanes[4];
+    simd4f scale;
+    simd4f offset;
+    simd4f zero;
+    simd4f top;
+    float v;
+    int i;
+
+    scale = simd4f_set1(palette->scale);
+    offset = simd4f_set1(palette->offset);
+    zero = simd4f_set1(0);
+    top = simd4f_set1(palette->size - 0.5f);
+
+    // The lower clamp comes first with the reading as its first operand,
+    // so a NaN reading ends up on entry 0 on every path
+    for(i = 0; i + 4 <= n; i += 4)
+    {
+        simd4f_store_int(lanes, simd4f_min(simd4f_max(simd4f_add(simd4f_mul(simd4f_load(to + i), scale), offset), zero), top));
+        index[i] = lanes[0];
+        index[i + 1] = lanes[1];
+        index[i + 2] = lanes[2];
+        index[i + 3] = lanes[3];
+    }
+    for(; i < n; i++)
+    {
+        v = to[i] * palette->scale + palette->offset;
+        index[i] = (v > 0) ? ((v < palette->size - 0.5f) ? (int)v : palette->size - 1) : 0;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_Colourise(const MLX90640_Palette *palette, const float *to, void *dst, int n)
+{
+    uint16_t index[INDEX_RUN];
+    uint8_t *p;
+    int run;
+
+    p = (uint8_t *)dst;
+    for(int i = 0; i < n; i += INDEX_RUN)
+    {
+        run = (n - i < INDEX_RUN) ? n - i : INDEX_RUN;
+        MLX90640_PaletteIndex(palette, to + i, index, run);
+
+        // One loop per pixel size keeps the copies fixed width
+        switch(palette->bytesPerPixel)
+        {
+            case 2:
+                for(int x = 0; x < run; x++)
+                {
+                    memcpy(p + 2 * x, palette->colour[index[x]], 2);
+                }
+                break;
+            case 3:
+                for(int x = 0; x < run; x++)
+                {
+                    memcpy(p + 3 * x, palette->colour[index[x]], 3);
+                }
+                break;
+            default:
+                for(int x = 0; x < run; x++)
+                {
+                    memcpy(p + 4 * x, palette->colour[index[x]], 4);
+                }
+                break;
+        }
+        p += run * palette->bytesPerPixel;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+const uint8_t *MLX90640_PaletteColour(const MLX90640_Palette *palette, float to)
+{
+    uint16_t index;
+
+    MLX90640_PaletteIndex(palette, &to, &index, 1);
+
+    return palette->colour[index];
+}
+
+//------------------------------------------------------------------------------
+
+static void EncodeColour(int r, int g, int b, int format, uint8_t *colour)
+{
+    uint16_t rgb565;
+
+    switch(format)
+    {
+        case MLX90640_FORMAT_RGB565:
+            rgb565 = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+            memcpy(colour, &rgb565, 2);
+            break;
+        case MLX90640_FORMAT_RGBA32:
+        case MLX90640_FORMAT_BGR24:
+            colour[0] = r;
+            colour[1] = g;
+            colour[2] = b;
+            colour[3] = 0xFF;
+            break;
+        default:
+            colour[0] = b;
+            colour[1] = g;
+            colour[2] = r;
+            colour[3] = 0xFF;
+            break;
+    }
+}
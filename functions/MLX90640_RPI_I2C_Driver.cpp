@@ -16,51 +16,75 @@
  */
 #include "MLX90640_I2C_Driver.h"
 #include <iostream>
+#include <stdio.h>
 #include <bcm2835.h>
 
-int init = 0;
+static int RPII2CInit(void);
+static int RPII2CRead(uint8_t slaveAddr, uint16_t startAddress, uint16_t nWords, uint8_t *buf);
+static int RPII2CWrite(uint8_t slaveAddr, uint16_t writeAddress, uint16_t data);
+static int RPII2CFreqSet(int freq);
 
-void MLX90640_I2CInit()
+const MLX90640_I2CBackend MLX90640_RPII2CBackend =
 {
-    
-}
+    "rpi",
+    RPII2CInit,
+    RPII2CRead,
+    RPII2CWrite,
+    0,
+    RPII2CFreqSet
+};
 
-int MLX90640_I2CRead(uint8_t slaveAddr, uint16_t startAddress, uint16_t nMemAddressRead, uint16_t *data)
+static int RPII2CInit(void)
 {
-    if(!init){
-        bcm2835_init();
-    	bcm2835_i2c_begin();
-	bcm2835_i2c_set_baudrate(400000);
-	init = 1;
+    if(!bcm2835_init()){
+        printf("bcm2835 Init Error!\n");
+        return -1;
+    }
+    if(!bcm2835_i2c_begin()){
+        printf("bcm2835 I2C Begin Error!\n");
+        return -1;
     }
+    bcm2835_i2c_set_baudrate(400000);
+    return 0;
+}
 
+static int RPII2CRead(uint8_t slaveAddr, uint16_t startAddress, uint16_t nWords, uint8_t *buf)
+{
     int result;
 
     char cmd[2] = {(char)(startAddress >> 8), (char)(startAddress & 0xFF)};
-    
 
     bcm2835_i2c_setSlaveAddress(slaveAddr);
 
-    char buf[1664];
-    uint16_t *p = data;
-
-    result = bcm2835_i2c_write_read_rs(cmd, 2, buf, nMemAddressRead*2);
-
-    for(int count = 0; count < nMemAddressRead; count++){
-	int i = count << 1;
-    	*p++ = ((uint16_t)buf[i] << 8) | buf[i+1];
+    result = bcm2835_i2c_write_read_rs(cmd, 2, (char*)buf, nWords*2);
+    if(result != BCM2835_I2C_REASON_OK){
+        printf("I2C Read Error!\n");
+        return -1;
     }
+
     return 0;
 } 
 
-void MLX90640_I2CFreqSet(int freq)
-{
-}
-
-int MLX90640_I2CWrite(uint8_t slaveAddr, uint16_t writeAddress, uint16_t data)
+static int RPII2CWrite(uint8_t slaveAddr, uint16_t writeAddress, uint16_t data)
 {
     int result;
     char cmd[4] = {(char)(writeAddress >> 8), (char)(writeAddress & 0x00FF), (char)(data >> 8), (char)(data & 0x00FF)};
+
+    bcm2835_i2c_setSlaveAddress(slaveAddr);
+
     result = bcm2835_i2c_write(cmd, 4);
+    if(result != BCM2835_I2C_REASON_OK){
+        printf("I2C Write Error!\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int RPII2CFreqSet(int freq)
+{
+    if(freq <= 0){
+        return -1;
+    }
+    bcm2835_i2c_set_baudrate(1000 * freq);
     return 0;
 }
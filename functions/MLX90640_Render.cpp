@@ -0,0 +1,325 @@
+/**
+ * @copyright (C) 2017 Melexis N.V.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <MLX90640_Render.h>
+#include "MLX90640_SIMD.h"
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+#define MAX_UPSCALE_THREADS 16
+
+// Output rows are coloured in runs of this many pixels so the blended
+// values stay in a stack buffer
+#define COLOUR_RUN 64
+
+static int InitTables(MLX90640_Upscaler *upscaler, int srcWidth, int srcHeight, int dstWidth, int dstHeight, int nearest);
+static void BuildWeights(int srcSize, int dstSize, int *index, float *weight);
+static void BuildNearest(int srcSize, int dstSize, int *index, float *weight);
+static inline void BlendRun(const MLX90640_Upscaler *upscaler, int y, int x0, int n, float *out);
+
+//------------------------------------------------------------------------------
+
+int MLX90640_UpscalerInit(MLX90640_Upscaler *upscaler, int srcWidth, int srcHeight, int dstWidth, int dstHeight)
+{
+    return InitTables(upscaler, srcWidth, srcHeight, dstWidth, dstHeight, 0);
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_UpscalerInitNearest(MLX90640_Upscaler *upscaler, int srcWidth, int srcHeight, int dstWidth, int dstHeight)
+{
+    return InitTables(upscaler, srcWidth, srcHeight, dstWidth, dstHeight, 1);
+}
+
+//------------------------------------------------------------------------------
+
+static int InitTables(MLX90640_Upscaler *upscaler, int srcWidth, int srcHeight, int dstWidth, int dstHeight, int nearest)
+{
+    memset(upscaler, 0, sizeof(MLX90640_Upscaler));
+    if(srcWidth < 1 || srcHeight < 1 || dstWidth < 1 || dstHeight < 1)
+    {
+        return -1;
+    }
+
+    upscaler->srcWidth = srcWidth;
+    upscaler->srcHeight = srcHeight;
+    upscaler->dstWidth = dstWidth;
+    upscaler->dstHeight = dstHeight;
+    upscaler->xIndex = (int *)malloc(4 * dstWidth * sizeof(int));
+    upscaler->xWeight = (float *)malloc(4 * dstWidth * sizeof(float));
+    upscaler->yIndex = (int *)malloc(4 * dstHeight * sizeof(int));
+    upscaler->yWeight = (float *)malloc(4 * dstHeight * sizeof(float));
+    upscaler->columns = (float *)malloc(srcHeight * dstWidth * sizeof(float));
+    if(upscaler->xIndex == 0 || upscaler->xWeight == 0 || upscaler->yIndex == 0 || upscaler->yWeight == 0 || upscaler->columns == 0)
+    {
+        MLX90640_UpscalerFree(upscaler);
+        return -1;
+    }
+
+    if(nearest)
+    {
+        BuildNearest(srcWidth, dstWidth, upscaler->xIndex, upscaler->xWeight);
+        BuildNearest(srcHeight, dstHeight, upscaler->yIndex, upscaler->yWeight);
+    }
+    else
+    {
+        BuildWeights(srcWidth, dstWidth, upscaler->xIndex, upscaler->xWeight);
+        BuildWeights(srcHeight, dstHeight, upscaler->yIndex, upscaler->yWeight);
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_UpscalerFree(MLX90640_Upscaler *upscaler)
+{
+    free(upscaler->xIndex);
+    free(upscaler->xWeight);
+    free(upscaler->yIndex);
+    free(upscaler->yWeight);
+    free(upscaler->columns);
+    memset(upscaler, 0, sizeof(MLX90640_Upscaler));
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_Upscale(MLX90640_Upscaler *upscaler, const float *src, float *dst)
+{
+    MLX90640_UpscaleHorizontal(upscaler, src);
+    MLX90640_UpscaleRows(upscaler, dst, 0, upscaler->dstHeight);
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_UpscaleHorizontal(MLX90640_Upscaler *upscaler, const float *src)
+{
+    const float *row;
+    const int *index;
+    const float *weight;
+    float *out;
+
+    for(int y = 0; y < upscaler->srcHeight; y++)
+    {
+        row = &src[y * upscaler->srcWidth];
+        out = &upscaler->columns[y * upscaler->dstWidth];
+        index = upscaler->xIndex;
+        weight = upscaler->xWeight;
+        for(int x = 0; x < upscaler->dstWidth; x++)
+        {
+            out[x] = weight[0] * row[index[0]] + weight[1] * row[index[1]] + weight[2] * row[index[2]] + weight[3] * row[index[3]];
+            index += 4;
+            weight += 4;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_UpscaleRows(const MLX90640_Upscaler *upscaler, float *dst, int firstRow, int lastRow)
+{
+    const float *r[4];
+    simd4f w[4];
+    simd4f sum;
+    float *out;
+    int width;
+    int x;
+
+    width = upscaler->dstWidth;
+    for(int y = firstRow; y < lastRow && y < upscaler->dstHeight; y++)
+    {
+        for(int k = 0; k < 4; k++)
+        {
+            r[k] = &upscaler->columns[upscaler->yIndex[4 * y + k] * width];
+            w[k] = simd4f_set1(upscaler->yWeight[4 * y + k]);
+        }
+        out = &dst[y * width];
+
+        for(x = 0; x + 4 <= width; x += 4)
+        {
+            sum = simd4f_mul(w[0], simd4f_load(r[0] + x));
+            sum = simd4f_add(sum, simd4f_mul(w[1], simd4f_load(r[1] + x)));
+            sum = simd4f_add(sum, simd4f_mul(w[2], simd4f_load(r[2] + x)));
+            sum = simd4f_add(sum, simd4f_mul(w[3], simd4f_load(r[3] + x)));
+            simd4f_store(out + x, sum);
+        }
+        for(; x < width; x++)
+        {
+            out[x] = upscaler->yWeight[4 * y] * r[0][x] + upscaler->yWeight[4 * y + 1] * r[1][x] +
+                     upscaler->yWeight[4 * y + 2] * r[2][x] + upscaler->yWeight[4 * y + 3] * r[3][x];
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_UpscaleThreaded(MLX90640_Upscaler *upscaler, const float *src, float *dst, int nThreads)
+{
+    std::thread threads[MAX_UPSCALE_THREADS];
+    int rowsPerThread;
+    int first;
+
+    if(nThreads > MAX_UPSCALE_THREADS)
+    {
+        nThreads = MAX_UPSCALE_THREADS;
+    }
+    if(nThreads > upscaler->dstHeight)
+    {
+        nThreads = upscaler->dstHeight;
+    }
+    if(nThreads < 2)
+    {
+        MLX90640_Upscale(upscaler, src, dst);
+        return 1;
+    }
+
+    // The horizontal pass is a small fraction of the work, only the
+    // vertical pass is split
+    MLX90640_UpscaleHorizontal(upscaler, src);
+
+    rowsPerThread = (upscaler->dstHeight + nThreads - 1) / nThreads;
+    for(int i = 1; i < nThreads; i++)
+    {
+        first = i * rowsPerThread;
+        threads[i] = std::thread(MLX90640_UpscaleRows, upscaler, dst, first, first + rowsPerThread);
+    }
+    MLX90640_UpscaleRows(upscaler, dst, 0, rowsPerThread);
+    for(int i = 1; i < nThreads; i++)
+    {
+        threads[i].join();
+    }
+
+    return nThreads;
+}
+
+//------------------------------------------------------------------------------
+
+static void BuildWeights(int srcSize, int dstSize, int *index, float *weight)
+{
+    float scale;
+    float position;
+    float t;
+    int base;
+    int i;
+
+    scale = (dstSize > 1) ? (srcSize - 1.0f) / (dstSize - 1.0f) : 0;
+    for(int d = 0; d < dstSize; d++)
+    {
+        position = d * scale;
+        base = (int)position;
+        t = position - base;
+
+        // Catmull-Rom weights of the pixels at base-1 .. base+2
+        weight[0] = 0.5f * (-t + 2 * t * t - t * t * t);
+        weight[1] = 1 + 0.5f * (-5 * t * t + 3 * t * t * t);
+        weight[2] = 0.5f * (t + 4 * t * t - 3 * t * t * t);
+        weight[3] = 0.5f * (-t * t + t * t * t);
+
+        for(int k = 0; k < 4; k++)
+        {
+            i = base - 1 + k;
+            if(i < 0)
+            {
+                i = 0;
+            }
+            if(i > srcSize - 1)
+            {
+                i = srcSize - 1;
+            }
+            index[k] = i;
+        }
+        index += 4;
+        weight += 4;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+static void BuildNearest(int srcSize, int dstSize, int *index, float *weight)
+{
+    int i;
+
+    // Same four tap layout, with all the weight on the middle tap so each
+    // source pixel covers an equal block of output pixels
+    for(int d = 0; d < dstSize; d++)
+    {
+        i = (int)(((long)d * srcSize) / dstSize);
+        for(int k = 0; k < 4; k++)
+        {
+            index[k] = i;
+            weight[k] = 0;
+        }
+        weight[1] = 1.0f;
+        index += 4;
+        weight += 4;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_UpscaleFalseColour(MLX90640_Upscaler *upscaler, const float *src, const MLX90640_Palette *palette, void *dst, int stride)
+{
+    float run[COLOUR_RUN];
+    uint8_t *row;
+    int n;
+
+    MLX90640_UpscaleHorizontal(upscaler, src);
+
+    for(int y = 0; y < upscaler->dstHeight; y++)
+    {
+        row = (uint8_t *)dst + (long)y * stride;
+        for(int x0 = 0; x0 < upscaler->dstWidth; x0 += COLOUR_RUN)
+        {
+            n = upscaler->dstWidth - x0;
+            if(n > COLOUR_RUN)
+            {
+                n = COLOUR_RUN;
+            }
+            BlendRun(upscaler, y, x0, n, run);
+            MLX90640_Colourise(palette, run, row + x0 * palette->bytesPerPixel, n);
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+
+static inline void BlendRun(const MLX90640_Upscaler *upscaler, int y, int x0, int n, float *out)
+{
+    const float *r[4];
+    const float *w;
+    simd4f sum;
+    int x;
+
+    w = &upscaler->yWeight[4 * y];
+    for(int k = 0; k < 4; k++)
+    {
+        r[k] = &upscaler->columns[upscaler->yIndex[4 * y + k] * upscaler->dstWidth + x0];
+    }
+
+    for(x = 0; x + 4 <= n; x += 4)
+    {
+        sum = simd4f_mul(simd4f_set1(w[0]), simd4f_load(r[0] + x));
+        sum = simd4f_add(sum, simd4f_mul(simd4f_set1(w[1]), simd4f_load(r[1] + x)));
+        sum = simd4f_add(sum, simd4f_mul(simd4f_set1(w[2]), simd4f_load(r[2] + x)));
+        sum = simd4f_add(sum, simd4f_mul(simd4f_set1(w[3]), simd4f_load(r[3] + x)));
+        simd4f_store(out + x, sum);
+    }
+    for(; x < n; x++)
+    {
+        out[x] = w[0] * r[0][x] + w[1] * r[1][x] + w[2] * r[2][x] + w[3] * r[3][x];
+    }
+}
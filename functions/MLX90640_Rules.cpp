@@ -0,0 +1,337 @@
+/**
+ * @copyright (C) 2017 Melexis N.V.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <MLX90640_Rules.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int CheckRule(const MLX90640_Rule *rule);
+static int FindRoi(const MLX90640_Roi *rois, int n, const MLX90640_Roi *roi);
+
+//------------------------------------------------------------------------------
+
+int MLX90640_RulesCompile(MLX90640_RuleSet *set, const MLX90640_Rule *rules, int n)
+{
+    int16_t pixelIndex[768];
+    int *roiIndex;
+    int *rateIndex;
+    int rawCount;
+    int slot;
+    int blobSlots;
+
+    memset(set, 0, sizeof(MLX90640_RuleSet));
+    if(n < 1 || n > 65535)
+    {
+        return -1;
+    }
+    for(int i = 0; i < n; i++)
+    {
+        if(CheckRule(&rules[i]) < 0)
+        {
+            return -1;
+        }
+    }
+
+    // Every rule could need a slot of its own, plus the rate of it
+    set->value = (float *)malloc((5 * n + 2) * sizeof(float));
+    set->previous = (float *)malloc((5 * n + 2) * sizeof(float));
+    set->pixel = (uint16_t *)malloc(n * sizeof(uint16_t));
+    set->roi = (MLX90640_Roi *)malloc(n * sizeof(MLX90640_Roi));
+    set->roiStats = (MLX90640_RoiStats *)malloc(n * sizeof(MLX90640_RoiStats));
+    set->rateSource = (int *)malloc(n * sizeof(int));
+    set->ruleSlot = (int *)malloc(n * sizeof(int));
+    set->ruleId = (uint16_t *)malloc(n * sizeof(uint16_t));
+    set->sign = (float *)malloc(n * sizeof(float));
+    set->trigger = (float *)malloc(n * sizeof(float));
+    set->release = (float *)malloc(n * sizeof(float));
+    set->minFrames = (uint16_t *)malloc(n * sizeof(uint16_t));
+    set->count = (uint16_t *)calloc(n, sizeof(uint16_t));
+    set->active = (uint8_t *)calloc(n, sizeof(uint8_t));
+    roiIndex = (int *)malloc(n * sizeof(int));
+    rateIndex = (int *)malloc((4 * n + 2) * sizeof(int));
+    if(set->value == 0 || set->previous == 0 || set->pixel == 0 || set->roi == 0 || set->roiStats == 0 ||
+       set->rateSource == 0 || set->ruleSlot == 0 || set->ruleId == 0 || set->sign == 0 || set->trigger == 0 ||
+       set->release == 0 || set->minFrames == 0 || set->count == 0 || set->active == 0 || roiIndex == 0 || rateIndex == 0)
+    {
+        free(roiIndex);
+        free(rateIndex);
+        MLX90640_RulesFree(set);
+        return -1;
+    }
+
+    // First gather the distinct pixels and ROIs, so the slots of each kind
+    // come out in one block: pixels, then mean, min and max of every ROI,
+    // then the two blob values and last the rates
+    memset(pixelIndex, 0xFF, sizeof(pixelIndex));
+    blobSlots = 0;
+    for(int i = 0; i < n; i++)
+    {
+        roiIndex[i] = -1;
+        if(rules[i].source == MLX90640_RULE_PIXEL)
+        {
+            if(pixelIndex[rules[i].pixel] < 0)
+            {
+                pixelIndex[rules[i].pixel] = set->pixelCount;
+                set->pixel[set->pixelCount] = rules[i].pixel;
+                set->pixelCount = set->pixelCount + 1;
+            }
+        }
+        else if(rules[i].source <= MLX90640_RULE_ROI_MAX)
+        {
+            roiIndex[i] = FindRoi(set->roi, set->roiCount, &rules[i].roi);
+            if(roiIndex[i] < 0)
+            {
+                roiIndex[i] = set->roiCount;
+                set->roi[set->roiCount] = rules[i].roi;
+                set->roiCount = set->roiCount + 1;
+            }
+        }
+        else
+        {
+            blobSlots = 2;
+        }
+    }
+
+    set->blobSlot = (blobSlots > 0) ? set->pixelCount + 3 * set->roiCount : -1;
+    rawCount = set->pixelCount + 3 * set->roiCount + blobSlots;
+    for(int i = 0; i < rawCount; i++)
+    {
+        rateIndex[i] = -1;
+    }
+
+    for(int i = 0; i < n; i++)
+    {
+        if(rules[i].source == MLX90640_RULE_PIXEL)
+        {
+            slot = pixelIndex[rules[i].pixel];
+        }
+        else if(rules[i].source <= MLX90640_RULE_ROI_MAX)
+        {
+            slot = set->pixelCount + 3 * roiIndex[i] + rules[i].source - MLX90640_RULE_ROI_MEAN;
+        }
+        else
+        {
+            slot = set->blobSlot + rules[i].source - MLX90640_RULE_BLOB_COUNT;
+        }
+
+        if(rules[i].rate)
+        {
+            if(rateIndex[slot] < 0)
+            {
+                rateIndex[slot] = set->rateCount;
+                set->rateSource[set->rateCount] = slot;
+                set->rateCount = set->rateCount + 1;
+            }
+            slot = rawCount + rateIndex[slot];
+        }
+
+        // Below rules are run as above rules on the negated value, so the
+        // evaluation loop has a single compare
+        set->ruleSlot[i] = slot;
+        set->ruleId[i] = rules[i].id;
+        set->sign[i] = (rules[i].compare == MLX90640_RULE_ABOVE) ? 1.0f : -1.0f;
+        set->trigger[i] = set->sign[i] * rules[i].threshold;
+        set->release[i] = set->trigger[i] - rules[i].hysteresis;
+        set->minFrames[i] = (rules[i].minFrames > 0) ? rules[i].minFrames : 1;
+    }
+
+    free(roiIndex);
+    free(rateIndex);
+
+    if(set->roiCount > 0)
+    {
+        set->roiTables = (MLX90640_RoiTables *)malloc(sizeof(MLX90640_RoiTables));
+        if(set->roiTables == 0)
+        {
+            MLX90640_RulesFree(set);
+            return -1;
+        }
+    }
+
+    set->ruleCount = n;
+    set->slotCount = rawCount + set->rateCount;
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_RulesFree(MLX90640_RuleSet *set)
+{
+    free(set->value);
+    free(set->previous);
+    free(set->pixel);
+    free(set->roi);
+    free(set->roiStats);
+    free(set->roiTables);
+    free(set->rateSource);
+    free(set->ruleSlot);
+    free(set->ruleId);
+    free(set->sign);
+    free(set->trigger);
+    free(set->release);
+    free(set->minFrames);
+    free(set->count);
+    free(set->active);
+    memset(set, 0, sizeof(MLX90640_RuleSet));
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_RulesEvaluate(MLX90640_RuleSet *set, const float *to, const MLX90640_BlobList *blobs, float dt, MLX90640_RuleEvent *events, int maxEvents)
+{
+    float *value;
+    float peak;
+    float v;
+    int rateBase;
+    int source;
+    int slot;
+    int nEvents;
+
+    value = set->value;
+    for(int i = 0; i < set->pixelCount; i++)
+    {
+        value[i] = to[set->pixel[i]];
+    }
+
+    if(set->roiCount > 0)
+    {
+        MLX90640_RoiTablesUpdate(set->roiTables, to);
+        MLX90640_GetRoiStats(set->roiTables, set->roi, set->roiCount, set->roiStats);
+        slot = set->pixelCount;
+        for(int i = 0; i < set->roiCount; i++)
+        {
+            value[slot] = set->roiStats[i].mean;
+            value[slot + 1] = set->roiStats[i].min;
+            value[slot + 2] = set->roiStats[i].max;
+            slot = slot + 3;
+        }
+    }
+
+    if(set->blobSlot >= 0)
+    {
+        // Without blobs there is no peak, which releases any peak rule
+        peak = NAN;
+        if(blobs != 0)
+        {
+            for(int i = 0; i < blobs->count; i++)
+            {
+                if(!(blobs->blob[i].peak <= peak))
+                {
+                    peak = blobs->blob[i].peak;
+                }
+            }
+        }
+        value[set->blobSlot] = (blobs != 0) ? blobs->count : NAN;
+        value[set->blobSlot + 1] = peak;
+    }
+
+    rateBase = set->slotCount - set->rateCount;
+    for(int i = 0; i < set->rateCount; i++)
+    {
+        source = set->rateSource[i];
+        value[rateBase + i] = (set->primed && dt > 0) ? (value[source] - set->previous[source]) / dt : 0;
+        set->previous[source] = value[source];
+    }
+    set->primed = 1;
+
+    nEvents = 0;
+    for(int i = 0; i < set->ruleCount; i++)
+    {
+        v = set->sign[i] * value[set->ruleSlot[i]];
+        if(set->active[i] == 0)
+        {
+            // NaN never counts towards raising
+            if(v > set->trigger[i])
+            {
+                set->count[i] = set->count[i] + 1;
+            }
+            else
+            {
+                set->count[i] = 0;
+            }
+            if(set->count[i] < set->minFrames[i])
+            {
+                continue;
+            }
+            set->active[i] = 1;
+        }
+        else if(v >= set->release[i])
+        {
+            continue;
+        }
+        else
+        {
+            // Also reached by a value that could not be measured
+            set->active[i] = 0;
+            set->count[i] = 0;
+        }
+
+        if(nEvents < maxEvents)
+        {
+            events[nEvents].rule = i;
+            events[nEvents].id = set->ruleId[i];
+            events[nEvents].active = set->active[i];
+            events[nEvents].value = set->sign[i] * v;
+            nEvents = nEvents + 1;
+        }
+    }
+
+    return nEvents;
+}
+
+//------------------------------------------------------------------------------
+
+static int CheckRule(const MLX90640_Rule *rule)
+{
+    const MLX90640_Roi *roi;
+
+    if(rule->source > MLX90640_RULE_BLOB_PEAK || rule->compare > MLX90640_RULE_BELOW || !(rule->hysteresis >= 0))
+    {
+        return -1;
+    }
+    if(rule->source == MLX90640_RULE_PIXEL && rule->pixel > 767)
+    {
+        return -1;
+    }
+    if(rule->source >= MLX90640_RULE_ROI_MEAN && rule->source <= MLX90640_RULE_ROI_MAX)
+    {
+        roi = &rule->roi;
+        if(roi->left > roi->right || roi->right > 31 || roi->top > roi->bottom || roi->bottom > 23)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+
+static int FindRoi(const MLX90640_Roi *rois, int n, const MLX90640_Roi *roi)
+{
+    // Only run at compile time, a linear search is fine even for
+    // thousands of ROIs
+    for(int i = 0; i < n; i++)
+    {
+        if(rois[i].left == roi->left && rois[i].top == roi->top && rois[i].right == roi->right && rois[i].bottom == roi->bottom)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
@@ -0,0 +1,144 @@
+/**
+ * @copyright (C) 2017 Melexis N.V.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Four-wide float helpers for the frame processing code. NEON on ARM, SSE2
+ * on x86 and plain C everywhere else. Masks come out of the compares as all
+ * ones or all zeros per lane and are only meant to be fed to simd4f_and
+ * and simd4f_select, which picks a where the mask is set and b elsewhere.
+ * simd4f_store_int truncates towards zero on the way out.
+ * Not installed, the public headers never expose these types.
+ */
+#ifndef _MLX90640_SIMD_H_
+#define _MLX90640_SIMD_H_
+
+#include <stdint.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+#include <arm_neon.h>
+
+typedef float32x4_t simd4f;
+
+static inline simd4f simd4f_load(const float *p) { return vld1q_f32(p); }
+static inline void simd4f_store(float *p, simd4f a) { vst1q_f32(p, a); }
+static inline simd4f simd4f_set1(float a) { return vdupq_n_f32(a); }
+static inline simd4f simd4f_add(simd4f a, simd4f b) { return vaddq_f32(a, b); }
+static inline simd4f simd4f_sub(simd4f a, simd4f b) { return vsubq_f32(a, b); }
+static inline simd4f simd4f_mul(simd4f a, simd4f b) { return vmulq_f32(a, b); }
+static inline simd4f simd4f_min(simd4f a, simd4f b) { return vminq_f32(a, b); }
+static inline simd4f simd4f_max(simd4f a, simd4f b) { return vmaxq_f32(a, b); }
+static inline simd4f simd4f_abs(simd4f a) { return vabsq_f32(a); }
+static inline simd4f simd4f_le(simd4f a, simd4f b) { return vreinterpretq_f32_u32(vcleq_f32(a, b)); }
+static inline simd4f simd4f_and(simd4f mask, simd4f a) { return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(mask), vreinterpretq_u32_f32(a))); }
+static inline simd4f simd4f_select(simd4f mask, simd4f a, simd4f b) { return vbslq_f32(vreinterpretq_u32_f32(mask), a, b); }
+static inline void simd4f_store_int(int32_t *p, simd4f a) { vst1q_s32(p, vcvtq_s32_f32(a)); }
+#if defined(__aarch64__)
+static inline simd4f simd4f_div(simd4f a, simd4f b) { return vdivq_f32(a, b); }
+#else
+static inline simd4f simd4f_div(simd4f a, simd4f b)
+{
+    float32x4_t r = vrecpeq_f32(b);
+    r = vmulq_f32(r, vrecpsq_f32(b, r));
+    r = vmulq_f32(r, vrecpsq_f32(b, r));
+    return vmulq_f32(a, r);
+}
+#endif
+
+#elif defined(__SSE2__)
+
+#include <emmintrin.h>
+
+typedef __m128 simd4f;
+
+static inline simd4f simd4f_load(const float *p) { return _mm_loadu_ps(p); }
+static inline void simd4f_store(float *p, simd4f a) { _mm_storeu_ps(p, a); }
+static inline simd4f simd4f_set1(float a) { return _mm_set1_ps(a); }
+static inline simd4f simd4f_add(simd4f a, simd4f b) { return _mm_add_ps(a, b); }
+static inline simd4f simd4f_sub(simd4f a, simd4f b) { return _mm_sub_ps(a, b); }
+static inline simd4f simd4f_mul(simd4f a, simd4f b) { return _mm_mul_ps(a, b); }
+static inline simd4f simd4f_div(simd4f a, simd4f b) { return _mm_div_ps(a, b); }
+static inline simd4f simd4f_min(simd4f a, simd4f b) { return _mm_min_ps(a, b); }
+static inline simd4f simd4f_max(simd4f a, simd4f b) { return _mm_max_ps(a, b); }
+static inline simd4f simd4f_abs(simd4f a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+static inline simd4f simd4f_le(simd4f a, simd4f b) { return _mm_cmple_ps(a, b); }
+static inline simd4f simd4f_and(simd4f mask, simd4f a) { return _mm_and_ps(mask, a); }
+static inline simd4f simd4f_select(simd4f mask, simd4f a, simd4f b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+static inline void simd4f_store_int(int32_t *p, simd4f a) { _mm_storeu_si128((__m128i *)p, _mm_cvttps_epi32(a)); }
+
+#else
+
+#include <string.h>
+#include <math.h>
+
+typedef struct
+    {
+        float v[4];
+    } simd4f;
+
+static inline simd4f simd4f_load(const float *p) { simd4f r; memcpy(r.v, p, sizeof(r.v)); return r; }
+static inline void simd4f_store(float *p, simd4f a) { memcpy(p, a.v, sizeof(a.v)); }
+static inline simd4f simd4f_set1(float a) { simd4f r = {{a, a, a, a}}; return r; }
+static inline simd4f simd4f_add(simd4f a, simd4f b) { for(int i = 0; i < 4; i++) a.v[i] += b.v[i]; return a; }
+static inline simd4f simd4f_sub(simd4f a, simd4f b) { for(int i = 0; i < 4; i++) a.v[i] -= b.v[i]; return a; }
+static inline simd4f simd4f_mul(simd4f a, simd4f b) { for(int i = 0; i < 4; i++) a.v[i] *= b.v[i]; return a; }
+static inline simd4f simd4f_div(simd4f a, simd4f b) { for(int i = 0; i < 4; i++) a.v[i] /= b.v[i]; return a; }
+static inline simd4f simd4f_min(simd4f a, simd4f b) { for(int i = 0; i < 4; i++) a.v[i] = (a.v[i] < b.v[i]) ? a.v[i] : b.v[i]; return a; }
+static inline simd4f simd4f_max(simd4f a, simd4f b) { for(int i = 0; i < 4; i++) a.v[i] = (a.v[i] > b.v[i]) ? a.v[i] : b.v[i]; return a; }
+static inline simd4f simd4f_abs(simd4f a) { for(int i = 0; i < 4; i++) a.v[i] = fabsf(a.v[i]); return a; }
+static inline simd4f simd4f_le(simd4f a, simd4f b)
+{
+    simd4f r;
+    uint32_t bits;
+    for(int i = 0; i < 4; i++)
+    {
+        bits = (a.v[i] <= b.v[i]) ? 0xFFFFFFFF : 0;
+        memcpy(&r.v[i], &bits, sizeof(bits));
+    }
+    return r;
+}
+static inline simd4f simd4f_and(simd4f mask, simd4f a)
+{
+    uint32_t m;
+    uint32_t x;
+    for(int i = 0; i < 4; i++)
+    {
+        memcpy(&m, &mask.v[i], sizeof(m));
+        memcpy(&x, &a.v[i], sizeof(x));
+        x = x & m;
+        memcpy(&a.v[i], &x, sizeof(x));
+    }
+    return a;
+}
+static inline simd4f simd4f_select(simd4f mask, simd4f a, simd4f b)
+{
+    uint32_t m;
+    for(int i = 0; i < 4; i++)
+    {
+        memcpy(&m, &mask.v[i], sizeof(m));
+        if(m == 0)
+        {
+            a.v[i] = b.v[i];
+        }
+    }
+    return a;
+}
+static inline void simd4f_store_int(int32_t *p, simd4f a) { for(int i = 0; i < 4; i++) p[i] = (int32_t)a.v[i]; }
+
+#endif
+
+#endif
@@ -53,22 +53,33 @@ void Wait(int);
 
 static int freqCnt;
 
-void MLX90640_I2CInit()
+static int SWI2CInit(void);
+static int SWI2CRead(uint8_t slaveAddr, uint16_t startAddress, uint16_t nMemAddressRead, uint8_t *buf);
+static int SWI2CWrite(uint8_t slaveAddr, uint16_t writeAddress, uint16_t data);
+static int SWI2CFreqSet(int freq);
+
+const MLX90640_I2CBackend MLX90640_SWI2CBackend =
+{
+    "swi2c",
+    SWI2CInit,
+    SWI2CRead,
+    SWI2CWrite,
+    0,
+    SWI2CFreqSet
+};
+
+static int SWI2CInit(void)
 {   
     I2CStop();
+    return 0;
 }
     
-int MLX90640_I2CRead(uint8_t slaveAddr, uint16_t startAddress,uint16_t nMemAddressRead, uint16_t *data)
+static int SWI2CRead(uint8_t slaveAddr, uint16_t startAddress,uint16_t nMemAddressRead, uint8_t *buf)
 {
     uint8_t sa;
     int ack = 0;
-    int cnt = 0;
-    int i = 0;
     char cmd[2] = {0,0};
-    char i2cData[1664] = {0};
-    uint16_t *p;
     
-    p = data;
     sa = (slaveAddr << 1);
     cmd[0] = startAddress >> 8;
     cmd[1] = startAddress & 0x00FF;
@@ -106,25 +117,21 @@ int MLX90640_I2CRead(uint8_t slaveAddr, uint16_t startAddress,uint16_t nMemAddre
         return -1;
     } 
         
-    I2CReadBytes((nMemAddressRead << 1), i2cData);
+    I2CReadBytes((nMemAddressRead << 1), (char*)buf);
               
     I2CStop();   
 
-    for(cnt=0; cnt < nMemAddressRead; cnt++)
-    {
-        i = cnt << 1;
-        *p++ = (int)i2cData[i]*256 + (int)i2cData[i+1];
-    } 
     return 0;
   
 } 
 
-void MLX90640_I2CFreqSet(int freq)
+static int SWI2CFreqSet(int freq)
 {
     freqCnt = freq>>1;
+    return 0;
 }
 
-int MLX90640_I2CWrite(uint8_t slaveAddr, uint16_t writeAddress, uint16_t data)
+static int SWI2CWrite(uint8_t slaveAddr, uint16_t writeAddress, uint16_t data)
 {
     uint8_t sa;
     int ack = 0;
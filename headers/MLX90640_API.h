@@ -18,6 +18,36 @@
 #define _MLX640_API_H_
 
 #define SCALEALPHA 0.000001
+
+// One entry per pixel at most, so the bad pixel lists can never overflow
+#define MLX90640_MAX_BAD_PIXELS 768
+
+#define MLX90640_CORRECT_COPY 0
+#define MLX90640_CORRECT_MEAN2 1
+#define MLX90640_CORRECT_MEDIAN4 2
+#define MLX90640_CORRECT_GRADIENT 3
+
+/**
+ * Precomputed replacement for one bad pixel. method and offset are indexed
+ * by readout mode (0 interleaved, 1 chess), offsets are relative to pixel.
+ */
+typedef struct
+    {
+        uint16_t pixel;
+        uint8_t method[2];
+        int8_t offset[2][4];
+    } MLX90640_PixelCorrection;
+
+/**
+ * Precomputed raw-domain repair of one broken pixel: the mean of count
+ * neighbours at the given offsets, as MLX90640_InterpolateOutliers does it.
+ */
+typedef struct
+    {
+        uint16_t pixel;
+        uint8_t count;
+        int8_t offset[4];
+    } MLX90640_RawRepair;
     
 typedef struct
     {
@@ -38,7 +68,7 @@ typedef struct
         int16_t ct[5];
         uint16_t alpha[768];    
         uint8_t alphaScale;
-        int16_t offset[768];    
+        float offset[768];
         int8_t kta[768];
         uint8_t ktaScale;    
         int8_t kv[768];
@@ -46,10 +76,178 @@ typedef struct
         float cpAlpha[2];
         int16_t cpOffset[2];
         float ilChessC[3]; 
-        uint16_t brokenPixels[5];
-        uint16_t outlierPixels[5];  
+        uint16_t brokenPixels[MLX90640_MAX_BAD_PIXELS + 1];
+        uint16_t outlierPixels[MLX90640_MAX_BAD_PIXELS + 1];  
+        uint16_t brokenPixelCount;
+        uint16_t outlierPixelCount;
+        uint8_t badPixelMask[96];
+        uint16_t correctionCount;
+        MLX90640_PixelCorrection correction[MLX90640_MAX_BAD_PIXELS];
+        uint16_t rawRepairCount;
+        MLX90640_RawRepair rawRepair[MLX90640_MAX_BAD_PIXELS];
     } paramsMLX90640;
 
+/**
+ * Runtime bad pixel detector state. All statistics are exponentially
+ * weighted per pixel and only touched for the pixels of the subpage that
+ * was just converted. Pixels it promotes, like those passed to
+ * MLX90640_AddBadPixel, join the broken pixel list and both repair plans.
+ */
+typedef struct
+    {
+        float last[768];
+        float activity[768];
+        float residualMean[768];
+        float residualVar[768];
+        uint8_t strikes[768];
+        float globalActivity;
+        float globalVar;
+        uint32_t updates;
+    } MLX90640_PixelMonitor;
+
+/**
+ * Raw frame accumulator. Pixel and auxiliary words are summed as signed
+ * values per subpage so many subpages can be converted as one average.
+ */
+typedef struct
+    {
+        int32_t pixels[768];
+        int32_t aux[2][64];
+        uint16_t control[2];
+        uint16_t count[2];
+    } MLX90640_RawAccumulator;
+
+/**
+ * Frame summary filled by the *Summary conversions while the pixels are
+ * produced. It covers the whole result array: the pixels converted in the
+ * call plus the other subpage as left by the previous call. lowThreshold
+ * and highThreshold are set by the caller; countBelow and countAbove count
+ * the pixels under and over them. NaN pixels are left out of everything.
+ */
+typedef struct
+    {
+        float min;
+        float max;
+        uint16_t minPixel;
+        uint16_t maxPixel;
+        uint16_t count;
+        uint16_t countBelow;
+        uint16_t countAbove;
+        float lowThreshold;
+        float highThreshold;
+        double sum;
+        double sumSquares;
+    } MLX90640_FrameSummary;
+
+/**
+ * State of MLX90640_CalculateToIncremental, which keeps the raw word and To
+ * of every pixel from its last conversion and only converts again the
+ * pixels whose raw word has moved by more than rawThreshold counts since,
+ * so a kept pixel is off by at most that many counts (around a tenth of a
+ * degree each near room temperature, depending on the part).
+ * The whole subpage is converted when Ta or Vdd have moved by more than
+ * taThreshold or vddThreshold since its last full conversion, when the
+ * compensation pixel has drifted by more than rawThreshold counts after the
+ * tgc scaling, when the gain word, readout mode, emissivity or tr change,
+ * and every refreshInterval subpages (0 never). Bad pixels are corrected
+ * as CalculateToCorrected does. converted holds the number of pixels
+ * converted by the last call.
+ *
+ * The cache is not tied to the parameters it was built with. Call
+ * MLX90640_IncrementalReset after changing them, for instance with
+ * MLX90640_NucApply or MLX90640_AddBadPixel, so the next subpage of each
+ * kind is converted in full.
+ */
+typedef struct
+    {
+        int16_t raw[768];
+        float to[768];
+        float ta[2];
+        float vdd[2];
+        float gain[2];
+        float irDataCP[2];
+        float tr[2];
+        float emissivity[2];
+        uint8_t mode[2];
+        uint8_t primed[2];
+        uint16_t sinceRefresh[2];
+        uint16_t refreshInterval;
+        uint16_t rawThreshold;
+        uint16_t converted;
+        float taThreshold;
+        float vddThreshold;
+    } MLX90640_IncrementalState;
+
+/**
+ * Per-pixel emissivity and reflected temperature for scenes of mixed
+ * materials. Init fills the whole map with one emissivity and tr and
+ * SetRegion overrides a rectangle of columns left to right and rows top
+ * to bottom, inclusive. After changing emissivity or tr directly, call
+ * MLX90640_EmissivityMapUpdate. It precomputes 1 / emissivity and
+ * tr^4 * (1 - 1 / emissivity) per pixel, so the reflected term of
+ * MLX90640_CalculateToMap is one multiply-add with the frame's Ta^4 and a
+ * change of Ta needs no refresh.
+ */
+typedef struct
+    {
+        float emissivity[768];
+        float tr[768];
+        float invEmissivity[768];
+        float taTrOffset[768];
+    } MLX90640_EmissivityMap;
+
+/**
+ * User non-uniformity correction. Point a sensor at a uniform scene, pass
+ * every frame to MLX90640_NucCaptureFrame, which only sums them, and call
+ * MLX90640_NucCapturePoint once both subpages have been seen. reference is
+ * the scene temperature, or NaN to flatten to the frame mean. One point
+ * gives per-pixel offsets, a second scene at least a degree apart adds
+ * per-pixel gains.
+ *
+ * MLX90640_NucCompute turns the points into a table of offsets in raw
+ * counts and gains. A pixel whose gain comes out outside 0.5 to 2 is left
+ * uncorrected, as bad pixels are. The table is plain data that can be
+ * stored next to the EEPROM dump. MLX90640_NucApply folds it into
+ * params->offset and params->alpha, so conversion costs nothing extra.
+ * Apply it once to the parameters from MLX90640_ExtractParameters. A capture taken with a table
+ * already applied measures what is left over, and its table applies on
+ * top. The offsets are exact at the Ta and Vdd of the first capture.
+ */
+typedef struct
+    {
+        MLX90640_RawAccumulator acc;
+        float measured[2][768];
+        float target[2][768];
+        float offsetScale[768];
+        float reference[2];
+        uint8_t points;
+    } MLX90640_NucCapture;
+
+typedef struct
+    {
+        float offset[768];
+        float gain[768];
+    } MLX90640_NucTable;
+
+/**
+ * Bus budget filled by MLX90640_GetBusBudget. subPageRate is in Hz, the
+ * frequencies in kHz. readTime is how long the RAM read takes at burstFreq
+ * in milliseconds, busLoad the fraction of the bus time at busFreq taken
+ * by the traffic of each subpage. applied is set once
+ * MLX90640_SetBusClock has set the clock.
+ */
+typedef struct
+    {
+        float subPageRate;
+        uint32_t bitsPerSubPage;
+        int requiredFreq;
+        int busFreq;
+        int burstFreq;
+        float readTime;
+        float busLoad;
+        uint8_t applied;
+    } MLX90640_BusBudget;
+
     int MLX90640_DumpEE(uint8_t slaveAddr, uint16_t *eeData);
     int MLX90640_GetFrameData(uint8_t slaveAddr, uint16_t *frameData);
     int MLX90640_ExtractParameters(uint16_t *eeData, paramsMLX90640 *mlx90640);
@@ -66,6 +264,33 @@ typedef struct
     int MLX90640_SetInterleavedMode(uint8_t slaveAddr);
     int MLX90640_SetChessMode(uint8_t slaveAddr);
     void MLX90640_BadPixelsCorrection(uint16_t *pixels, float *to, int mode, paramsMLX90640 *params);
+    void MLX90640_CorrectPixels(float *to, int mode, const paramsMLX90640 *params);
+    int MLX90640_AddBadPixel(paramsMLX90640 *params, uint16_t pixel);
+    void MLX90640_PixelMonitorInit(MLX90640_PixelMonitor *monitor);
+    int MLX90640_PixelMonitorUpdate(MLX90640_PixelMonitor *monitor, uint16_t *frameData, const float *to, paramsMLX90640 *params);
+    void MLX90640_AccumulatorReset(MLX90640_RawAccumulator *acc);
+    int MLX90640_AccumulateFrame(MLX90640_RawAccumulator *acc, uint16_t *frameData);
+    float MLX90640_GetTaAccumulated(const MLX90640_RawAccumulator *acc, const paramsMLX90640 *params);
+    int MLX90640_CalculateToAccumulated(const MLX90640_RawAccumulator *acc, const paramsMLX90640 *params, float emissivity, float tr, float *result);
+    void MLX90640_CalculateToCorrected(uint16_t *frameData, const paramsMLX90640 *params, float emissivity, float tr, float *result);
+    void MLX90640_CalculateToSummary(uint16_t *frameData, const paramsMLX90640 *params, float emissivity, float tr, float *result, MLX90640_FrameSummary *summary);
+    void MLX90640_CalculateToCorrectedSummary(uint16_t *frameData, const paramsMLX90640 *params, float emissivity, float tr, float *result, MLX90640_FrameSummary *summary);
+    int MLX90640_CalculateToPixels(uint16_t *frameData, const paramsMLX90640 *params, float emissivity, float tr, const uint16_t *pixels, int n, float *result);
+    void MLX90640_CalculateRadiance(uint16_t *frameData, const paramsMLX90640 *params, float emissivity, float tr, float *result);
+    float MLX90640_TemperatureToRadiance(float to);
+    float MLX90640_RadianceToTemperature(float radiance);
+    void MLX90640_EmissivityMapInit(MLX90640_EmissivityMap *map, float emissivity, float tr);
+    int MLX90640_EmissivityMapSetRegion(MLX90640_EmissivityMap *map, int left, int top, int right, int bottom, float emissivity, float tr);
+    void MLX90640_EmissivityMapUpdate(MLX90640_EmissivityMap *map);
+    void MLX90640_CalculateToMap(uint16_t *frameData, const paramsMLX90640 *params, const MLX90640_EmissivityMap *map, float *result);
+    void MLX90640_NucCaptureReset(MLX90640_NucCapture *capture);
+    int MLX90640_NucCaptureFrame(MLX90640_NucCapture *capture, uint16_t *frameData);
+    int MLX90640_NucCapturePoint(MLX90640_NucCapture *capture, const paramsMLX90640 *params, float emissivity, float tr, float reference);
+    int MLX90640_NucCompute(const MLX90640_NucCapture *capture, const paramsMLX90640 *params, MLX90640_NucTable *table);
+    void MLX90640_NucApply(paramsMLX90640 *params, const MLX90640_NucTable *table);
+    void MLX90640_IncrementalInit(MLX90640_IncrementalState *state);
+    void MLX90640_IncrementalReset(MLX90640_IncrementalState *state);
+    int MLX90640_CalculateToIncremental(MLX90640_IncrementalState *state, uint16_t *frameData, const paramsMLX90640 *params, float emissivity, float tr, float *result);
 
     int MLX90640_SetDeviceMode(uint8_t slaveAddr, uint8_t deviceMode);
     int MLX90640_SetSubPageRepeat(uint8_t slaveAddr, uint8_t subPageRepeat);
@@ -76,5 +301,9 @@ typedef struct
     int MLX90640_DumpEE(uint8_t slaveAddr, uint16_t *eeData);
     int MLX90640_GetFrameData(uint8_t slaveAddr, uint16_t *frameData);
     int MLX90640_InterpolateOutliers(uint16_t *frameData, uint16_t *eepromData);
+    int MLX90640_GetFrameDataRepaired(uint8_t slaveAddr, uint16_t *frameData, const paramsMLX90640 *params);
+    int MLX90640_GetFrameDataPixels(uint8_t slaveAddr, uint16_t *frameData, const uint16_t *pixels, int n);
+    int MLX90640_GetBusBudget(uint8_t refreshRate, int maxFreq, MLX90640_BusBudget *budget);
+    int MLX90640_SetBusClock(uint8_t slaveAddr, uint8_t refreshRate, int maxFreq, MLX90640_BusBudget *budget);
 
 #endif
@@ -0,0 +1,246 @@
+/**
+ * @copyright (C) 2017 Melexis N.V.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef _MLX90640_Analysis_H_
+#define _MLX90640_Analysis_H_
+
+#include <stdint.h>
+
+#ifndef MLX90640_HISTOGRAM_BINS
+#define MLX90640_HISTOGRAM_BINS 1024
+#endif
+
+#ifndef MLX90640_MAX_BLOBS
+#define MLX90640_MAX_BLOBS 16
+#endif
+
+#ifndef MLX90640_MAX_TRACKS
+#define MLX90640_MAX_TRACKS 16
+#endif
+
+// Fixed by the 4x3 tiling of the change detector
+#define MLX90640_CHANGE_TILES 12
+
+#define MLX90640_THRESHOLD_ABSOLUTE 0
+#define MLX90640_THRESHOLD_RELATIVE 1
+
+/**
+ * Statistics of one frame. Init fixes the histogram to
+ * MLX90640_HISTOGRAM_BINS equal bins between histMin and histMax, readings
+ * outside land in the end bins. It fails unless histMax is above histMin. MLX90640_GetFrameStats fills min, max,
+ * mean and the histogram in a single pass over the readings, skipping
+ * NaNs; count is the number of readings used. The counts are 32 bit so
+ * an upscaled frame fits as well as a raw one.
+ *
+ * MLX90640_GetPercentile reads a percentile (fraction 0 to 1) off the
+ * histogram, interpolating within the bin, so it is exact to a bin width
+ * and never needs a sort.
+ */
+typedef struct
+    {
+        float histMin;
+        float binWidth;
+        float min;
+        float max;
+        float mean;
+        uint32_t count;
+        uint32_t histogram[MLX90640_HISTOGRAM_BINS + 1];
+    } MLX90640_FrameStats;
+
+/**
+ * Auto range state. Each update takes the lowPercentile and highPercentile
+ * readings of the frame, widens them to at least minSpan degrees and moves
+ * minTemp and maxTemp towards them by smoothing, so the palette follows
+ * the scene without flicker. Init sets usable defaults, the fields may be
+ * tuned afterwards.
+ */
+typedef struct
+    {
+        float minTemp;
+        float maxTemp;
+        float lowPercentile;
+        float highPercentile;
+        float minSpan;
+        float smoothing;
+        uint8_t primed;
+    } MLX90640_AutoRange;
+
+/**
+ * A hot object: 8-connected pixels above the detection level. x and y are
+ * the centroid in pixel units (column and row of the 32x24 frame), each
+ * pixel weighted by how far it is above the level. left, right, top and
+ * bottom bound the blob inclusively.
+ */
+typedef struct
+    {
+        float x;
+        float y;
+        float peak;
+        float mean;
+        uint16_t area;
+        uint16_t peakPixel;
+        uint8_t left;
+        uint8_t right;
+        uint8_t top;
+        uint8_t bottom;
+    } MLX90640_Blob;
+
+/**
+ * MLX90640_FindBlobs labels the pixels hotter than threshold
+ * (MLX90640_THRESHOLD_ABSOLUTE), or more than threshold above the frame
+ * median (MLX90640_THRESHOLD_RELATIVE), in one raster pass with a
+ * union-find, and keeps the blobs of at least minArea pixels. It returns
+ * their number. level is the temperature the pixels were compared with.
+ * The blobs are sorted by area, largest first, and at most
+ * MLX90640_MAX_BLOBS are kept. label holds for every pixel 1 + the index
+ * of its blob, or 0.
+ */
+typedef struct
+    {
+        float level;
+        int count;
+        MLX90640_Blob blob[MLX90640_MAX_BLOBS];
+        uint8_t label[768];
+    } MLX90640_BlobList;
+
+/**
+ * One tracked object. id is 0 for a free slot and otherwise unique for the
+ * life of the tracker. x, y and vx, vy are the filtered position in pixels
+ * and velocity in pixels per second; area, peak and mean are copied from
+ * the last blob matched. blob is the index of the blob matched by the
+ * latest update, or -1 while the track coasts on its prediction.
+ */
+typedef struct
+    {
+        uint32_t id;
+        uint16_t hits;
+        uint8_t misses;
+        uint8_t confirmed;
+        int8_t blob;
+        float x;
+        float y;
+        float vx;
+        float vy;
+        float peak;
+        float mean;
+        uint16_t area;
+    } MLX90640_Track;
+
+/**
+ * Multi-object tracker over the blobs of successive frames, in a fixed
+ * table of MLX90640_MAX_TRACKS slots. Every update predicts each track
+ * forward at constant velocity, pairs tracks and blobs nearest first
+ * within gate pixels, and corrects the matched tracks with an alpha-beta
+ * filter. A track is confirmed after confirmHits matches and dropped after
+ * more than maxMisses updates without one, or after its first miss if it
+ * was never confirmed. Blobs left over start new tracks while there are
+ * free slots. Init sets usable defaults, the fields may be tuned
+ * afterwards.
+ */
+typedef struct
+    {
+        MLX90640_Track track[MLX90640_MAX_TRACKS];
+        uint32_t nextId;
+        float gate;
+        float alpha;
+        float beta;
+        uint8_t confirmHits;
+        uint8_t maxMisses;
+    } MLX90640_Tracker;
+
+/**
+ * Region of interest, inclusive pixel bounds: columns left to right (0 to
+ * 31) and rows top to bottom (0 to 23).
+ */
+typedef struct
+    {
+        uint8_t left;
+        uint8_t top;
+        uint8_t right;
+        uint8_t bottom;
+    } MLX90640_Roi;
+
+typedef struct
+    {
+        float mean;
+        float variance;
+        float min;
+        float max;
+    } MLX90640_RoiStats;
+
+/**
+ * Per-frame tables for ROI queries. MLX90640_RoiTablesUpdate builds the
+ * summed-area tables of the readings and their squares, with a zero row
+ * and column in front, and for each row the minimum and maximum of every
+ * run of 2^k pixels. MLX90640_GetRoiStats then answers the mean and
+ * variance of any rectangle from four corners of each table, and its
+ * minimum and maximum from two overlapping runs per row, without touching
+ * the frame again. It returns the number of ROIs answered; invalid ROIs
+ * get NaN statistics. The frame must not contain NaNs.
+ */
+typedef struct
+    {
+        double sum[25 * 33];
+        double sumSquares[25 * 33];
+        float runMin[6][768];
+        float runMax[6][768];
+    } MLX90640_RoiTables;
+
+/**
+ * Change detector for skipping work on static scenes. Each pixel of the
+ * subpage just read is compared with a running background of that pixel,
+ * and the frame is split into twelve 8x8 tiles, four across and three down.
+ * A tile is flagged once at least minPixels of its pixels are more than
+ * threshold away from their background. The detection functions return
+ * the flags, bit 4 * row + column per tile, and leave the number of
+ * changed pixels per tile in changed.
+ *
+ * MLX90640_DetectChangeRaw works on the raw frame data before any
+ * conversion, with threshold in ADC counts (around ten counts to the
+ * degree near room temperature, depending on the part).
+ * MLX90640_DetectChange works on a converted frame with threshold in
+ * degrees. The background follows the readings by alpha each subpage, so
+ * slow drift and objects that stay put stop being flagged. All tiles are flagged on the first frame of each
+ * subpage and every refreshInterval subpages after (0 never), which bounds
+ * how long a consumer that skips unflagged tiles can fall behind.
+ */
+typedef struct
+    {
+        float background[768];
+        float threshold;
+        float alpha;
+        uint16_t minPixels;
+        uint16_t refreshInterval;
+        uint16_t sinceRefresh[2];
+        uint16_t changed[MLX90640_CHANGE_TILES];
+        uint8_t primed[2];
+    } MLX90640_ChangeDetector;
+
+    int MLX90640_FrameStatsInit(MLX90640_FrameStats *stats, float histMin, float histMax);
+    void MLX90640_GetFrameStats(MLX90640_FrameStats *stats, const float *to, int n);
+    float MLX90640_GetPercentile(const MLX90640_FrameStats *stats, float fraction);
+    void MLX90640_AutoRangeInit(MLX90640_AutoRange *range);
+    void MLX90640_AutoRangeUpdate(MLX90640_AutoRange *range, const MLX90640_FrameStats *stats);
+    int MLX90640_FindBlobs(const float *to, int mode, float threshold, int minArea, MLX90640_BlobList *blobs);
+    void MLX90640_TrackerInit(MLX90640_Tracker *tracker);
+    int MLX90640_TrackerUpdate(MLX90640_Tracker *tracker, const MLX90640_BlobList *blobs, float dt);
+    void MLX90640_RoiTablesUpdate(MLX90640_RoiTables *tables, const float *to);
+    int MLX90640_GetRoiStats(const MLX90640_RoiTables *tables, const MLX90640_Roi *rois, int n, MLX90640_RoiStats *stats);
+    void MLX90640_ChangeDetectorInit(MLX90640_ChangeDetector *detector, float threshold);
+    int MLX90640_DetectChangeRaw(MLX90640_ChangeDetector *detector, uint16_t *frameData);
+    int MLX90640_DetectChange(MLX90640_ChangeDetector *detector, uint16_t *frameData, const float *to);
+
+#endif
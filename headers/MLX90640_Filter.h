@@ -0,0 +1,83 @@
+/**
+ * @copyright (C) 2017 Melexis N.V.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef _MLX90640_Filter_H_
+#define _MLX90640_Filter_H_
+
+#include <stdint.h>
+
+#define MLX90640_FILTER_NONE 0
+#define MLX90640_FILTER_MEDIAN 1
+#define MLX90640_FILTER_SMOOTH 2
+
+#define MLX90640_TEMPORAL_EMA 0
+#define MLX90640_TEMPORAL_KALMAN 1
+
+/**
+ * Per-pixel temporal filter state. Only the pixels of the subpage that was
+ * just read are updated, the others keep their last estimate.
+ *
+ * EMA moves each estimate by alpha towards the new reading. KALMAN runs a
+ * constant-temperature Kalman filter per pixel, with processNoise and
+ * measurementNoise as variances in degrees squared, so the gain settles
+ * where the two balance. In both modes a reading more than motionThreshold
+ * degrees from the estimate replaces it outright, so moving objects do not
+ * smear; 0 disables the bypass. Init sets usable defaults, the fields may
+ * be tuned afterwards.
+ */
+typedef struct
+    {
+        float estimate[768];
+        float variance[768];
+        float alpha;
+        float processNoise;
+        float measurementNoise;
+        float motionThreshold;
+        uint8_t mode;
+        uint8_t primed[2];
+    } MLX90640_TemporalFilter;
+
+/**
+ * De-interlacer state. previous holds the last frame passed in, so the
+ * change of the freshly read pixels since their last reading can be told.
+ * motionThreshold is the change, in degrees, at which a stale pixel is
+ * fully replaced by interpolation from its fresh neighbours. The output
+ * of MLX90640_Deinterlace must not be the to buffer it reads.
+ */
+typedef struct
+    {
+        float previous[768];
+        float motionThreshold;
+        uint8_t primed;
+    } MLX90640_Deinterlacer;
+
+/**
+ * Spatial filters for the 32x24 temperature frame. Pixels outside the frame
+ * repeat the nearest edge pixel. in and out may be the same buffer.
+ *
+ * MLX90640_SmoothFilter averages each pixel with those of its eight
+ * neighbours that lie within threshold degrees of it, so noise is smoothed
+ * while edges steeper than threshold are kept.
+ */
+    void MLX90640_MedianFilter(const float *in, float *out);
+    void MLX90640_SmoothFilter(const float *in, float *out, float threshold);
+    void MLX90640_Filter(int filter, const float *in, float *out, float threshold);
+    void MLX90640_TemporalFilterInit(MLX90640_TemporalFilter *filter, int mode);
+    void MLX90640_TemporalFilterUpdate(MLX90640_TemporalFilter *filter, uint16_t *frameData, const float *to, float *out);
+    void MLX90640_DeinterlacerInit(MLX90640_Deinterlacer *deinterlacer);
+    void MLX90640_Deinterlace(MLX90640_Deinterlacer *deinterlacer, uint16_t *frameData, const float *to, float *out);
+
+#endif
@@ -19,8 +19,99 @@
 
 #include <stdint.h>
 
+#define MLX90640_I2C_MAX_BACKENDS 8
+#define MLX90640_I2C_MAX_MESSAGES 8
+
+#define MLX90640_I2C_MSG_READ 0
+#define MLX90640_I2C_MSG_WRITE 1
+
+#define MLX90640_I2C_PURPOSE_STATUS 0
+#define MLX90640_I2C_PURPOSE_RAM 1
+#define MLX90640_I2C_PURPOSE_CONTROL 2
+#define MLX90640_I2C_PURPOSE_EEPROM 3
+#define MLX90640_I2C_PURPOSE_OTHER 4
+#define MLX90640_I2C_PURPOSES 5
+
+#define MLX90640_I2C_PROFILE_BUCKETS 20
+
+/**
+ * One register access inside a combined transaction. Reads fill nWords
+ * words starting at address; writes send data[0] to address.
+ */
+typedef struct
+    {
+        uint16_t address;
+        uint16_t nWords;
+        uint16_t *data;
+        uint8_t flags;
+    } MLX90640_I2CMessage;
+
+/**
+ * I2C transport. read() returns the raw big-endian bytes as they came off
+ * the wire (2 * nWords), the driver layer unpacks them. transfer() and
+ * freqSet() may be NULL when the transport has no native support.
+ * Frequencies are in kHz.
+ */
+typedef struct
+    {
+        const char *name;
+        int (*init)(void);
+        int (*read)(uint8_t slaveAddr, uint16_t startAddress, uint16_t nWords, uint8_t *buf);
+        int (*write)(uint8_t slaveAddr, uint16_t writeAddress, uint16_t data);
+        int (*transfer)(uint8_t slaveAddr, MLX90640_I2CMessage *msgs, int nMsgs);
+        int (*freqSet)(int freq);
+    } MLX90640_I2CBackend;
+
+/**
+ * Per-purpose transaction statistics. Times are in microseconds, bytes count
+ * everything clocked on the bus apart from the slave address. Histogram
+ * bucket 0 holds calls under 2us and bucket n calls of 2^n to 2^(n+1) us,
+ * the last bucket collects everything slower.
+ */
+typedef struct
+    {
+        uint32_t calls;
+        uint32_t errors;
+        uint32_t retries;
+        uint64_t bytes;
+        uint64_t totalTime;
+        uint32_t minTime;
+        uint32_t maxTime;
+        uint32_t histogram[MLX90640_I2C_PROFILE_BUCKETS];
+    } MLX90640_I2CProfileStats;
+
+typedef struct
+    {
+        MLX90640_I2CProfileStats purpose[MLX90640_I2C_PURPOSES];
+    } MLX90640_I2CProfile;
+
     void MLX90640_I2CInit(void);
     int MLX90640_I2CRead(uint8_t slaveAddr,uint16_t startAddress, uint16_t nMemAddressRead, uint16_t *data);
     int MLX90640_I2CWrite(uint8_t slaveAddr,uint16_t writeAddress, uint16_t data);
+    int MLX90640_I2CTransfer(uint8_t slaveAddr, MLX90640_I2CMessage *msgs, int nMsgs);
+    int MLX90640_I2CReadBurst(uint8_t slaveAddr, uint16_t startAddress, uint16_t nMemAddressRead, uint16_t *data);
+    int MLX90640_I2CReadBurstBytes(uint8_t slaveAddr, uint16_t startAddress, uint16_t nMemAddressRead, uint8_t *buf);
     void MLX90640_I2CFreqSet(int freq);
-#endif
\ No newline at end of file
+    int MLX90640_I2CSetFreq(uint8_t slaveAddr, int freq);
+    int MLX90640_I2CSetBurstFreq(uint8_t slaveAddr, int freq);
+    int MLX90640_I2CGetFreq(uint8_t slaveAddr);
+
+    int MLX90640_I2CRegisterBackend(const MLX90640_I2CBackend *backend);
+    const MLX90640_I2CBackend *MLX90640_I2CFindBackend(const char *name);
+    int MLX90640_I2CGetBackendCount(void);
+    const MLX90640_I2CBackend *MLX90640_I2CGetBackendByIndex(int index);
+    int MLX90640_I2CSetDefaultBackend(const char *name);
+    int MLX90640_I2CSetBackend(uint8_t slaveAddr, const char *name);
+    const MLX90640_I2CBackend *MLX90640_I2CGetBackend(uint8_t slaveAddr);
+    void MLX90640_I2CProfileEnable(int enable);
+    void MLX90640_I2CProfileReset(void);
+    void MLX90640_I2CProfileSnapshot(MLX90640_I2CProfile *profile);
+    void MLX90640_I2CProfileRetry(uint16_t address);
+    int MLX90640_I2CGetPurpose(uint16_t address);
+    void MLX90640_I2CUnpack(const uint8_t *buf, uint16_t nWords, uint16_t *data);
+
+    extern const MLX90640_I2CBackend MLX90640_LinuxI2CBackend;
+    extern const MLX90640_I2CBackend MLX90640_RPII2CBackend;
+    extern const MLX90640_I2CBackend MLX90640_MbedI2CBackend;
+    extern const MLX90640_I2CBackend MLX90640_SWI2CBackend;
+#endif
@@ -0,0 +1,83 @@
+/**
+ * @copyright (C) 2017 Melexis N.V.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef _MLX90640_Palette_H_
+#define _MLX90640_Palette_H_
+
+#include <stdint.h>
+
+/**
+ * Pixel formats, named like the Linux DRM and framebuffer formats after
+ * the packed little-endian word, most significant component first. RGB565
+ * is one native-endian 16 bit word. RGB24 and XRGB8888 are B, G, R in
+ * memory (and a padding byte set to 0xFF), BGR24 is R, G, B as in raw RGB
+ * files. RGBA32 is the exception, named by its byte order like
+ * SDL_PIXELFORMAT_RGBA32: R, G, B, A in memory with A opaque.
+ */
+#define MLX90640_FORMAT_RGB565 0
+#define MLX90640_FORMAT_RGB24 1
+#define MLX90640_FORMAT_XRGB8888 2
+#define MLX90640_FORMAT_RGBA32 3
+#define MLX90640_FORMAT_BGR24 4
+
+#define MLX90640_PALETTE_HEATMAP 0
+#define MLX90640_PALETTE_IRON 1
+#define MLX90640_PALETTE_RAINBOW 2
+#define MLX90640_PALETTE_GREY 3
+
+#ifndef MLX90640_PALETTE_MAX_SIZE
+#define MLX90640_PALETTE_MAX_SIZE 4096
+#endif
+
+/**
+ * A false colour lookup table. Init expands one of the palettes above to
+ * size entries (256 or 4096, at most MLX90640_PALETTE_MAX_SIZE), each
+ * already encoded in format, so colouring a pixel is one multiply-add to
+ * find its entry and one copy of bytesPerPixel bytes. Temperatures below
+ * minTemp and above maxTemp get the end colours; the range can be moved
+ * at any time with MLX90640_PaletteSetRange, which does not touch the
+ * table.
+ *
+ * MLX90640_PaletteIndex quantises n temperatures to table entries,
+ * MLX90640_Colourise writes n consecutive pixels to dst and
+ * MLX90640_PaletteColour returns the encoded colour of one temperature.
+ *
+ * MLX90640_PaletteSetRadianceRange sets the range for colouring the output
+ * of MLX90640_CalculateRadiance directly. minTemp and maxTemp are still
+ * given in degrees and the fields then hold radiances. Colours follow
+ * radiance, which differs from following temperature by a few percent of
+ * the range over a span of tens of degrees.
+ */
+typedef struct
+    {
+        uint8_t colour[MLX90640_PALETTE_MAX_SIZE][4];
+        uint16_t size;
+        uint8_t format;
+        uint8_t bytesPerPixel;
+        float minTemp;
+        float maxTemp;
+        float scale;
+        float offset;
+    } MLX90640_Palette;
+
+    int MLX90640_PaletteInit(MLX90640_Palette *palette, int colours, int size, int format, float minTemp, float maxTemp);
+    int MLX90640_PaletteSetRange(MLX90640_Palette *palette, float minTemp, float maxTemp);
+    int MLX90640_PaletteSetRadianceRange(MLX90640_Palette *palette, float minTemp, float maxTemp);
+    void MLX90640_PaletteIndex(const MLX90640_Palette *palette, const float *to, uint16_t *index, int n);
+    void MLX90640_Colourise(const MLX90640_Palette *palette, const float *to, void *dst, int n);
+    const uint8_t *MLX90640_PaletteColour(const MLX90640_Palette *palette, float to);
+
+#endif
@@ -0,0 +1,62 @@
+/**
+ * @copyright (C) 2017 Melexis N.V.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef _MLX90640_Render_H_
+#define _MLX90640_Render_H_
+
+#include "MLX90640_Palette.h"
+
+/**
+ * Separable Catmull-Rom (bicubic) upscaler. Init works out, for every
+ * output column and row, the four source pixels it reads and their weights,
+ * so scaling a frame is a horizontal pass over the source rows followed by
+ * a vertical pass of four multiply-adds per output pixel. The corner
+ * pixels of source and output line up.
+ *
+ * The vertical pass can be split by output rows: call
+ * MLX90640_UpscaleHorizontal once, then MLX90640_UpscaleRows from as many
+ * threads as wanted, or let MLX90640_UpscaleThreaded do both.
+ *
+ * MLX90640_UpscalerInitNearest sets up the same tables for plain pixel
+ * replication, for blocky output at the same cost.
+ *
+ * MLX90640_UpscaleFalseColour scales straight into an image: every output
+ * pixel is coloured through palette and written in its format to dst,
+ * whose rows are stride bytes apart.
+ */
+typedef struct
+    {
+        int srcWidth;
+        int srcHeight;
+        int dstWidth;
+        int dstHeight;
+        int *xIndex;
+        float *xWeight;
+        int *yIndex;
+        float *yWeight;
+        float *columns;
+    } MLX90640_Upscaler;
+
+    int MLX90640_UpscalerInit(MLX90640_Upscaler *upscaler, int srcWidth, int srcHeight, int dstWidth, int dstHeight);
+    int MLX90640_UpscalerInitNearest(MLX90640_Upscaler *upscaler, int srcWidth, int srcHeight, int dstWidth, int dstHeight);
+    void MLX90640_UpscalerFree(MLX90640_Upscaler *upscaler);
+    void MLX90640_Upscale(MLX90640_Upscaler *upscaler, const float *src, float *dst);
+    void MLX90640_UpscaleHorizontal(MLX90640_Upscaler *upscaler, const float *src);
+    void MLX90640_UpscaleRows(const MLX90640_Upscaler *upscaler, float *dst, int firstRow, int lastRow);
+    int MLX90640_UpscaleThreaded(MLX90640_Upscaler *upscaler, const float *src, float *dst, int nThreads);
+    void MLX90640_UpscaleFalseColour(MLX90640_Upscaler *upscaler, const float *src, const MLX90640_Palette *palette, void *dst, int stride);
+
+#endif
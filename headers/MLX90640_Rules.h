@@ -0,0 +1,110 @@
+/**
+ * @copyright (C) 2017 Melexis N.V.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef _MLX90640_Rules_H_
+#define _MLX90640_Rules_H_
+
+#include <stdint.h>
+#include "MLX90640_Analysis.h"
+
+#define MLX90640_RULE_PIXEL 0
+#define MLX90640_RULE_ROI_MEAN 1
+#define MLX90640_RULE_ROI_MIN 2
+#define MLX90640_RULE_ROI_MAX 3
+#define MLX90640_RULE_BLOB_COUNT 4
+#define MLX90640_RULE_BLOB_PEAK 5
+
+#define MLX90640_RULE_ABOVE 0
+#define MLX90640_RULE_BELOW 1
+
+/**
+ * One alarm rule. source picks the value watched: a pixel's temperature,
+ * the mean, minimum or maximum of roi, the number of blobs or the peak of
+ * the hottest blob. With rate set the rule watches the change of that
+ * value in degrees (or blobs) per second instead.
+ *
+ * The rule is raised once the value has been past threshold (above or
+ * below, as compare says) for minFrames evaluations in a row, and cleared
+ * as soon as it is back by more than hysteresis on the other side. id is
+ * passed through to the events.
+ */
+typedef struct
+    {
+        uint8_t source;
+        uint8_t compare;
+        uint8_t rate;
+        uint16_t pixel;
+        MLX90640_Roi roi;
+        float threshold;
+        float hysteresis;
+        uint16_t minFrames;
+        uint16_t id;
+    } MLX90640_Rule;
+
+/**
+ * Raised (active 1) or cleared (active 0) rule, with the value that did
+ * it. rule is the index of the rule as passed to MLX90640_RulesCompile.
+ */
+typedef struct
+    {
+        uint16_t rule;
+        uint16_t id;
+        uint8_t active;
+        float value;
+    } MLX90640_RuleEvent;
+
+/**
+ * Compiled rule set. Compile gives every distinct value the rules watch
+ * one slot, so a pixel or ROI shared by many rules is read or measured
+ * once, and flattens the rules into arrays of slot, trigger and release
+ * levels with the compare folded into the sign. MLX90640_RulesEvaluate
+ * fills the slots from the frame and the blobs (which may be 0 when no
+ * rule watches them), runs the rules and writes up to maxEvents events,
+ * returning their number. dt is the time since the previous evaluation in
+ * seconds. Compile allocates, returns -1 on a bad rule or when out of
+ * memory, and the set is released with MLX90640_RulesFree.
+ */
+typedef struct
+    {
+        int ruleCount;
+        int slotCount;
+        int pixelCount;
+        int roiCount;
+        int rateCount;
+        int blobSlot;
+        uint8_t primed;
+        float *value;
+        float *previous;
+        uint16_t *pixel;
+        MLX90640_Roi *roi;
+        MLX90640_RoiStats *roiStats;
+        MLX90640_RoiTables *roiTables;
+        int *rateSource;
+        int *ruleSlot;
+        uint16_t *ruleId;
+        float *sign;
+        float *trigger;
+        float *release;
+        uint16_t *minFrames;
+        uint16_t *count;
+        uint8_t *active;
+    } MLX90640_RuleSet;
+
+    int MLX90640_RulesCompile(MLX90640_RuleSet *set, const MLX90640_Rule *rules, int n);
+    void MLX90640_RulesFree(MLX90640_RuleSet *set);
+    int MLX90640_RulesEvaluate(MLX90640_RuleSet *set, const float *to, const MLX90640_BlobList *blobs, float dt, MLX90640_RuleEvent *events, int maxEvents);
+
+#endif
@@ -2,7 +2,13 @@
 %include "stdint.i"
 
 %{
+#include "MLX90640/MLX90640_Analysis.h"
 int setup(int fps);
+int set_i2c_backend(const char *name);
+int set_filter(int mode, float threshold);
+int set_temporal_filter(int mode, float motion_threshold);
+int set_tracker(float threshold, int min_area);
+MLX90640_Track * get_tracks(void);
 void cleanup(void);
 float * get_frame(void);
 %}
@@ -14,6 +20,22 @@ float * get_frame(void);
     }
 %}
 
+%typemap(out) MLX90640_Track *get_tracks %{
+    $result = PyList_New(0);
+    for (int i = 0; i < MLX90640_MAX_TRACKS; ++i) {
+        if ($1[i].id != 0 && $1[i].confirmed) {
+            PyObject *track = Py_BuildValue("(Iffffif)", (unsigned int)$1[i].id, $1[i].x, $1[i].y, $1[i].vx, $1[i].vy, $1[i].area, $1[i].peak);
+            PyList_Append($result, track);
+            Py_DECREF(track);
+        }
+    }
+%}
+
 int setup(int fps);
+int set_i2c_backend(const char *name);
+int set_filter(int mode, float threshold);
+int set_temporal_filter(int mode, float motion_threshold);
+int set_tracker(float threshold, int min_area);
+MLX90640_Track * get_tracks(void);
 void cleanup(void);
 float * get_frame(void);
@@ -7,6 +7,8 @@
 #include <math.h>
 #include "MLX90640/MLX90640_API.h"
 #include "MLX90640/MLX90640_I2C_Driver.h"
+#include "MLX90640/MLX90640_Analysis.h"
+#include "MLX90640/MLX90640_Filter.h"
 
 #define MLX_I2C_ADDR 0x33
 
@@ -16,13 +18,24 @@
 // to account for this.
 #define OFFSET_MICROS 850
 
-int baudrate = 400000;
+MLX90640_BusBudget busBudget;
 paramsMLX90640 mlx90640;
 static uint16_t eeMLX90640[832];
 float emissivity = 1;
 uint16_t frame[834];
 // static float image[768];
 static float mlx90640To[768];
+static float filteredTo[768];
+int filter = MLX90640_FILTER_NONE;
+float filterThreshold = 2.0;
+static MLX90640_TemporalFilter temporalFilter;
+bool temporalEnabled = false;
+static MLX90640_BlobList blobs;
+static MLX90640_Tracker tracker;
+bool trackerEnabled = false;
+float trackerThreshold = 5.0;
+int trackerMinArea = 2;
+float subPageTime = 0.125;
 float eTa;
 // static uint16_t data[768*sizeof(float)];
 
@@ -36,31 +49,24 @@ int setup(int fps){
 	switch(fps){
 		case 1:
 			MLX90640_SetRefreshRate(MLX_I2C_ADDR, 0b001);
-			baudrate = 400000;
 			break;
 		case 2:
 			MLX90640_SetRefreshRate(MLX_I2C_ADDR, 0b010);
-			baudrate = 400000;
 			break;
 		case 4:
 			MLX90640_SetRefreshRate(MLX_I2C_ADDR, 0b011);
-			baudrate = 400000;
 			break;
 		case 8:
 			MLX90640_SetRefreshRate(MLX_I2C_ADDR, 0b100);
-			baudrate = 400000;
 			break;
 		case 16:
 			MLX90640_SetRefreshRate(MLX_I2C_ADDR, 0b101);
-			baudrate = 1000000;
 			break;
 		case 32:
 			MLX90640_SetRefreshRate(MLX_I2C_ADDR, 0b110);
-			baudrate = 1000000;
 			break;
 		case 64:
 			MLX90640_SetRefreshRate(MLX_I2C_ADDR, 0b111);
-			baudrate = 1000000;
 			break;
 		default:
 #ifdef DEBUG
@@ -69,12 +75,75 @@ int setup(int fps){
 			return 1;
 	}
 	MLX90640_SetChessMode(MLX_I2C_ADDR);
+	subPageTime = 1.0 / fps;
+
+	// Run the bus no faster than the refresh rate needs, bursting to 1MHz
+	// for the RAM read when the I2C backend can change its clock
+	if(MLX90640_SetBusClock(MLX_I2C_ADDR, MLX90640_GetRefreshRate(MLX_I2C_ADDR), 1000, &busBudget) != 0){
+#ifdef DEBUG
+		printf("%d FPS needs a %dkHz bus\n", fps, busBudget.requiredFreq);
+#endif
+	}
+#ifdef DEBUG
+	printf("Bus clock %dkHz (%s), burst %dkHz, load %.0f%%\n", busBudget.busFreq,
+		busBudget.applied ? "applied" : "set it in /boot/config.txt", busBudget.burstFreq, busBudget.busLoad * 100);
+#endif
 	MLX90640_DumpEE(MLX_I2C_ADDR, eeMLX90640);
 	MLX90640_ExtractParameters(eeMLX90640, &mlx90640);
 
 	return 0;
 }
 
+//extern "C" 
+int set_i2c_backend(const char *name){
+	return MLX90640_I2CSetBackend(MLX_I2C_ADDR, name);
+}
+
+//extern "C" 
+int set_filter(int mode, float threshold){
+	if(mode != MLX90640_FILTER_NONE && mode != MLX90640_FILTER_MEDIAN && mode != MLX90640_FILTER_SMOOTH){
+		return 1;
+	}
+	filter = mode;
+	filterThreshold = threshold;
+	return 0;
+}
+
+//extern "C" 
+int set_temporal_filter(int mode, float motion_threshold){
+	if(mode < 0){
+		temporalEnabled = false;
+		return 0;
+	}
+	if(mode != MLX90640_TEMPORAL_EMA && mode != MLX90640_TEMPORAL_KALMAN){
+		return 1;
+	}
+	MLX90640_TemporalFilterInit(&temporalFilter, mode);
+	temporalFilter.motionThreshold = motion_threshold;
+	temporalEnabled = true;
+	return 0;
+}
+
+//extern "C" 
+int set_tracker(float threshold, int min_area){
+	// Starting afresh, or emptying the table so get_tracks does not keep
+	// returning the last tracks once tracking is off
+	MLX90640_TrackerInit(&tracker);
+	if(threshold <= 0){
+		trackerEnabled = false;
+		return 0;
+	}
+	trackerThreshold = threshold;
+	trackerMinArea = min_area;
+	trackerEnabled = true;
+	return 0;
+}
+
+//extern "C" 
+MLX90640_Track * get_tracks(void){
+	return tracker.track;
+}
+
 //extern "C" 
 void cleanup(void){
 	//nothing...
@@ -107,14 +176,23 @@ float * get_frame(void){
 #endif
 
 		eTa = MLX90640_GetTa(frame, &mlx90640);
-		MLX90640_CalculateTo(frame, &mlx90640, emissivity, eTa, mlx90640To);
-
-		MLX90640_BadPixelsCorrection((&mlx90640)->brokenPixels, mlx90640To, 1, &mlx90640);
-		MLX90640_BadPixelsCorrection((&mlx90640)->outlierPixels, mlx90640To, 1, &mlx90640);
+		MLX90640_CalculateToCorrected(frame, &mlx90640, emissivity, eTa, mlx90640To);
+		if(temporalEnabled){
+			MLX90640_TemporalFilterUpdate(&temporalFilter, frame, mlx90640To, mlx90640To);
+		}
+		if(trackerEnabled){
+			MLX90640_FindBlobs(mlx90640To, MLX90640_THRESHOLD_RELATIVE, trackerThreshold, trackerMinArea, &blobs);
+			MLX90640_TrackerUpdate(&tracker, &blobs, subPageTime);
+		}
 	}
 #ifdef DEBUG
 	printf("Finishing\n");
 #endif
 
+	if(filter != MLX90640_FILTER_NONE){
+		MLX90640_Filter(filter, mlx90640To, filteredTo, filterThreshold);
+		return filteredTo;
+	}
+
 	return mlx90640To;
 }